@@ -1,9 +1,12 @@
 #include "RFControl.h"
 
-#ifndef RF_CONTROL_VARDUINO
-#include "arduino_functions.h"
+#if defined(RF_CONTROL_HAL)
+// Platform functions chosen at compile time, e.g. the simulator's
+#include RF_CONTROL_HAL
+#elif defined(RF_CONTROL_VARDUINO)
+#error "RF_CONTROL_VARDUINO is no longer supported, name a header with the hw_* functions in RF_CONTROL_HAL instead"
 #else
-#define byte uint8_t
+#include "arduino_functions.h"
 #endif
 
 // Scale down time by 4 to fit in 16 bit unsigned int
@@ -18,6 +21,15 @@
 // Minimum signal period time for a proper message
 #define MIN_PERIOD_TIME (120 / PULSE_LENGTH_DIVIDER)
 
+// Pulses in a row before the channel is considered busy
+#define CARRIER_MIN_STREAK 4
+
+// Give up waiting for the channel and send anyway
+#define CSMA_TIMEOUT 5000000UL
+
+// Max exponent of the random backoff window
+#define CSMA_MAX_BACKOFF 6
+
 // Remembers the time of the last interrupt
 volatile unsigned int lastTime;
 
@@ -36,9 +48,64 @@ volatile byte reader;
 // Circular message buffer (256) and extended raw buffer
 volatile unsigned int msgbuf[MAX_RECORDINGS];
 
+// Buffer pointer to the message following the one unfolded by getRaw()
+byte rawNext;
+
+// Indicates that rawNext is valid
+bool rawUnfolded = false;
+
 // Interrupt Service Routine
 void isr();
 
+// Carrier sense, time of the last edge of a message in the air, the
+// period time of that message and the gap before its repeats
+volatile unsigned long lastActivity;
+volatile unsigned int activityPeriod = 0;
+volatile unsigned int activityGap = 0;
+
+// Set by the isr when a message ends or breaks off
+volatile bool channelEvent = false;
+
+// Wakes an asynchronous send waiting for the channel
+void txChannelEvent();
+
+RFTransmitStats txStats;
+
+// Receive while sending, edges within echoWindow micros after one of our
+// own edges are dropped. 0 stops receiving while sending.
+unsigned int echoWindow = 0;
+volatile unsigned long lastTxEdge;
+
+// Streaming compression of the message being received, two slots so that
+// one message can be read while the next is captured
+struct StreamSlot {
+  unsigned long sums[8];
+  unsigned int counts[8];
+  unsigned int periodTime;
+  unsigned int size;
+  uint8_t *data;
+};
+StreamSlot streamSlots[2];
+
+// Period count of the first pulse in each bucket of the active slot
+unsigned int streamCodes[8];
+
+// Number of used buckets in the active slot
+byte streamCodeCount;
+
+// Max number of pulses in a slot, zero if streaming is disabled
+unsigned int streamCapacity = 0;
+
+// Slot written by the isr
+byte streamActive;
+
+// Slot holding a complete message, or STREAM_NONE
+#define STREAM_NONE 0xff
+volatile byte streamReady = STREAM_NONE;
+
+// Too many buckets or pulses in the active slot
+bool streamOverflow;
+
 // RF GPIO IN
 int interruptPin = -1;
 
@@ -58,6 +125,11 @@ void RFControl::startReceiving(int _interruptPin) {
   writer = 0;
   reader = 0;
   streak = 0;
+  rawUnfolded = false;
+  activityPeriod = 0;
+  activityGap = 0;
+  streamReady = STREAM_NONE;
+  streamOverflow = true;
   
   if(interruptPin != -1) {
     hw_detachInterrupt(interruptPin);   
@@ -102,20 +174,39 @@ void RFControl::getRaw(unsigned int **buffer, unsigned int* timings_size) {
       msgbuf[start + size++] = pt * msgbuf[(byte)(reader + pos++)];
     }
     if (size >= max_size) {
-      // Unable to fit message from circular buffer in flat buffer. Drop message
+      // Unable to fit message from circular buffer in flat buffer. Drop
+      // message, the part unfolded so far can not be scanned again so
+      // find its end here
       size = 0;
+      while ((byte)(reader+pos) != writer && msgbuf[(byte)(reader+pos)] <= MAX_PULSE_PERIODS) {
+        pos++;
+      }
+      if ((byte)(reader+pos) != writer) {
+        pos++;
+      }
     }
-    else if ((reader+pos) != writer) {
+    else if ((byte)(reader+pos) != writer) {
       // Include sync at end
       msgbuf[start + size++] = pt * msgbuf[(byte)(reader + pos++)];      
     }
+    rawNext = reader + pos;
+    rawUnfolded = true;
   }
   *timings_size = size;
   *buffer = (unsigned int*)&msgbuf[start];
 }
 
+/* The unfolded message overwrites the period counts in the circular
+   buffer and the caller is free to modify it further, e.g. by
+   compressing it in place. Use the message end found by getRaw()
+   rather than scanning the buffer when possible.
+ */
 void RFControl::continueReceiving() {
-  if (reader != writer) {
+  if (rawUnfolded) {
+    rawUnfolded = false;
+    reader = rawNext;
+  }
+  else if (reader != writer) {
     // Go to next message
     reader++;
     while (reader != writer && msgbuf[reader] <= MAX_PULSE_PERIODS) {
@@ -128,6 +219,60 @@ void RFControl::continueReceiving() {
   }
 }
 
+/* Messages can be compressed while they are captured. buffer is used
+   for the packed bucket indices of two messages and must stay valid
+   until disableStreamCompression() is called. Messages that do not fit
+   in half the buffer, or need more than 8 buckets, are only available
+   through getRaw(). Captured messages are also stored as raw messages
+   as before, so continueReceiving() must still be called to make room
+   for new messages.
+ */
+void RFControl::enableStreamCompression(uint8_t *buffer, unsigned int buffer_size) {
+  if(interruptPin != -1) {
+    hw_detachInterrupt(interruptPin);
+  }
+  unsigned int half = buffer_size / 2;
+  streamSlots[0].data = buffer;
+  streamSlots[1].data = buffer + half;
+  streamCapacity = half * 8 / 3;
+  streamActive = 0;
+  streamReady = STREAM_NONE;
+  // Wait for the next sync before compressing
+  streamOverflow = true;
+  if(interruptPin != -1) {
+    hw_attachInterrupt(interruptPin, isr);
+  }
+}
+
+void RFControl::disableStreamCompression() {
+  streamCapacity = 0;
+  streamReady = STREAM_NONE;
+}
+
+bool RFControl::hasCompressedData() {
+  return streamReady != STREAM_NONE;
+}
+
+void RFControl::getCompressed(RFPackedTimings *message) {
+  if (streamReady == STREAM_NONE) {
+    message->size = 0;
+    return;
+  }
+  StreamSlot *slot = &streamSlots[streamReady];
+  for (int j = 0; j < 8; j++) {
+    message->buckets[j] = 0;
+    if (slot->counts[j] != 0) {
+      message->buckets[j] = slot->periodTime * slot->sums[j] / slot->counts[j];
+    }
+  }
+  message->size = slot->size;
+  message->data = slot->data;
+}
+
+void RFControl::continueCompressed() {
+  streamReady = STREAM_NONE;
+}
+
 unsigned int RFControl::getLastDuration(){
   new_duration = false;
   return duration;
@@ -137,12 +282,81 @@ bool RFControl::existNewDuration(){
   return new_duration;
 }
 
+/* Streaming compression follows the rules of compressTimings(), but
+   works on period counts as they arrive in the isr. The bucket table
+   is kept as sums and counts, the division into the final bucket
+   values is left to getCompressed() since it is too slow for the isr.
+ */
+void streamReset() {
+  if (streamCapacity == 0) {
+    return;
+  }
+  StreamSlot *slot = &streamSlots[streamActive];
+  for (byte j = 0; j < 8; j++) {
+    slot->sums[j] = 0;
+    slot->counts[j] = 0;
+  }
+  slot->size = 0;
+  streamCodeCount = 0;
+  streamOverflow = false;
+}
+
+void streamFeed(unsigned int periods) {
+  if (streamCapacity == 0 || streamOverflow) {
+    return;
+  }
+  StreamSlot *slot = &streamSlots[streamActive];
+  if (slot->size == streamCapacity) {
+    streamOverflow = true;
+    return;
+  }
+  byte j = 0;
+  for (; j < streamCodeCount; j++) {
+    // Same 37.5% window as compressTimings(), scaled by 8. Long syncs
+    // overflow a 16 bit unsigned int when scaled.
+    unsigned long refVal = streamCodes[j];
+    unsigned long delta = 3 * refVal;
+    unsigned long val = 8UL * periods;
+    if (8 * refVal - delta < val && val < 8 * refVal + delta) {
+      break;
+    }
+  }
+  if (j == streamCodeCount) {
+    if (j == 8) {
+      streamOverflow = true;
+      return;
+    }
+    streamCodes[streamCodeCount++] = periods;
+  }
+  slot->sums[j] += periods;
+  slot->counts[j]++;
+  RFControl::setPackedIndex(slot->data, slot->size++, j);
+}
+
+void streamCommit(unsigned int pt) {
+  if (streamCapacity == 0 || streamOverflow || streamReady != STREAM_NONE) {
+    // Not compressible or the previous message is still being read
+    return;
+  }
+  streamSlots[streamActive].periodTime = pt;
+  streamReady = streamActive;
+  streamActive ^= 1;
+}
+
 void isr()
 {
-  unsigned int now = hw_micros() / PULSE_LENGTH_DIVIDER;
+  unsigned long fullNow = hw_micros();
+  if (echoWindow && fullNow - lastTxEdge < echoWindow) {
+    // Our own transmitter, leave the receiver state as it is
+    txStats.echoes++;
+    return;
+  }
+  unsigned int now = fullNow / PULSE_LENGTH_DIVIDER;
   unsigned int pulseTime = now - lastTime;
-  unsigned int periods = (pulseTime + periodTime/2) / periodTime;
-  byte lowPulse = digitalRead(interruptPin + 2);
+  byte previousStreak = streak;
+  // periodTime is zero until the first high pulse has been seen
+  unsigned int periods = periodTime ? (pulseTime + periodTime/2) / periodTime : 0;
+  byte lowPulse = hw_digitalRead(interruptPin + 2);
 
   lastTime = now;
   duration = pulseTime;
@@ -161,6 +375,7 @@ void isr()
     }
     else {
       msgbuf[index] = periods;
+      streamFeed(periods);
     }
   }
 
@@ -171,9 +386,12 @@ void isr()
         // Message complete
         msgbuf[writer] = periodTime;
         writer = (writer + streak);
+        streamCommit(periodTime);
+        activityGap = pulseTime;
       }
       // Start new message
       streak = 1;
+      streamReset();
     }
   }
   else {
@@ -193,6 +411,17 @@ void isr()
       periodTime = pulseTime;
     }
   }
+
+  if (streak > CARRIER_MIN_STREAK) {
+    lastActivity = fullNow;
+    activityPeriod = periodTime;
+  }
+  else if (previousStreak > CARRIER_MIN_STREAK) {
+    // Message complete or broken off, the guard time starts now
+    lastActivity = fullNow;
+    channelEvent = true;
+    txChannelEvent();
+  }
 }
 
 
@@ -341,33 +570,434 @@ bool RFControl::compressTimingsAndSortBuckets(unsigned int buckets[8], unsigned
   return true;
 }
 
-void listenBeforeTalk()
-{
-  // listen before talk
-  unsigned long waited = 0;
-  if(interruptPin != -1) {
-      waited += 500;
-      hw_delayMicroseconds(500); 
-    while(streak > 0) {
-      //wait till no rf message is in the air
-      waited += 5;
-      hw_delayMicroseconds(3); // 5 - some micros for other stuff
-      // don't wait longer than 5sec
-      if(waited > 5000000) {
-        break;
+unsigned int RFControl::getPackedSize(unsigned int timings_size) {
+  return (timings_size * 3 + 7) / 8;
+}
+
+/* Packs bucket indices three bits per pulse. packed may point to the
+   same memory as timings, byte n of the packed stream is only written
+   after all timings overlapping it have been read. This makes it
+   possible to pack a message in place in the buffer from getRaw().
+ */
+void RFControl::packTimings(unsigned int *timings, unsigned int timings_size, uint8_t *packed) {
+  unsigned int acc = 0;
+  byte bits = 0;
+  unsigned int pos = 0;
+  for(unsigned int i = 0; i < timings_size; i++) {
+    acc |= (timings[i] & 7) << bits;
+    bits += 3;
+    if(bits >= 8) {
+      packed[pos++] = acc;
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  if(bits > 0) {
+    packed[pos] = acc;
+  }
+}
+
+uint8_t RFControl::getPackedIndex(const uint8_t *packed, unsigned int i) {
+  unsigned int bit = i * 3;
+  byte shift = bit & 7;
+  unsigned int val = packed[bit >> 3] >> shift;
+  if(shift > 5) {
+    // index spans two bytes
+    val |= packed[(bit >> 3) + 1] << (8 - shift);
+  }
+  return val & 7;
+}
+
+void RFControl::setPackedIndex(uint8_t *packed, unsigned int i, uint8_t index) {
+  unsigned int bit = i * 3;
+  byte shift = bit & 7;
+  unsigned int pos = bit >> 3;
+  packed[pos] = (packed[pos] & ~(7 << shift)) | ((index & 7) << shift);
+  if(shift > 5) {
+    packed[pos + 1] = (packed[pos + 1] & ~(7 >> (8 - shift))) | ((index & 7) >> (8 - shift));
+  }
+}
+
+/* Compresses timings and packs the result in place. On success
+   message->data points into the timings buffer, so the message is
+   only valid until continueReceiving() is called.
+ */
+bool RFControl::compressTimingsPacked(RFPackedTimings *message, unsigned int *timings, unsigned int timings_size) {
+  if(!compressTimings(message->buckets, timings, timings_size)) {
+    return false;
+  }
+  message->size = timings_size;
+  message->data = (uint8_t*)timings;
+  packTimings(timings, timings_size, message->data);
+  return true;
+}
+
+void RFControl::unpackTimings(const RFPackedTimings *message, unsigned int *timings) {
+  for(unsigned int i = 0; i < message->size; i++) {
+    timings[i] = getPackedIndex(message->data, i);
+  }
+}
+
+/* Decodes pairs of bucket indices into bits, from either unpacked
+   indices or a packed message. rank maps the indices to the ones the
+   decoder uses, 0 keeps them. Returns the number of bits, or -1 if a
+   pair is not in the decoder or the payload does not fit.
+ */
+int decodePairBits(const RFPairDecoder *decoder, const unsigned int *timings, const uint8_t *packed, const uint8_t *rank, unsigned int timings_size, uint8_t *payload, unsigned int payload_size) {
+  unsigned int end = timings_size - decoder->footer;
+  if (timings_size < (unsigned int)decoder->header + decoder->footer || ((end - decoder->header) & 1)) {
+    return -1;
+  }
+  unsigned int bits = (end - decoder->header) / 2;
+  if (bits > payload_size * 8) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < (bits + 7) / 8; i++) {
+    payload[i] = 0;
+  }
+  unsigned int n = 0;
+  for (unsigned int i = decoder->header; i < end; i += 2, n++) {
+    byte first;
+    byte second;
+    if (packed) {
+      first = RFControl::getPackedIndex(packed, i);
+      second = RFControl::getPackedIndex(packed, i + 1);
+    }
+    else {
+      first = timings[i] & 7;
+      second = timings[i + 1] & 7;
+    }
+    if (rank) {
+      first = rank[first];
+      second = rank[second];
+    }
+    byte pair = RF_PAIR(first, second);
+    byte mask = decoder->bitOrder == RF_LSB_FIRST ? 1 << (n & 7) : 0x80 >> (n & 7);
+    if (pair == decoder->one) {
+      payload[n >> 3] |= mask;
+    }
+    else if (pair != decoder->zero) {
+      return -1;
+    }
+  }
+  return bits;
+}
+
+/* Packs up to 64 decoded bits into an integer. With RF_MSB_FIRST the
+   first bit is the most significant bit of the result, with
+   RF_LSB_FIRST it is bit 0.
+ */
+int payloadFromBytes(const RFPairDecoder *decoder, const uint8_t *bytes, int bits, uint64_t *payload) {
+  *payload = 0;
+  if (bits <= 0) {
+    return bits;
+  }
+  int size = (bits + 7) / 8;
+  if (decoder->bitOrder == RF_LSB_FIRST) {
+    for (int i = size - 1; i >= 0; i--) {
+      *payload = (*payload << 8) | bytes[i];
+    }
+  }
+  else {
+    for (int i = 0; i < size; i++) {
+      *payload = (*payload << 8) | bytes[i];
+    }
+    *payload >>= size * 8 - bits;
+  }
+  return bits;
+}
+
+int RFControl::decodePairsToBytes(const RFPairDecoder *decoder, const unsigned int *timings, unsigned int timings_size, uint8_t *payload, unsigned int payload_size) {
+  return decodePairBits(decoder, timings, 0, 0, timings_size, payload, payload_size);
+}
+
+int RFControl::decodePairs(const RFPairDecoder *decoder, const unsigned int *timings, unsigned int timings_size, uint64_t *payload) {
+  uint8_t bytes[8];
+  int bits = decodePairBits(decoder, timings, 0, 0, timings_size, bytes, sizeof(bytes));
+  return payloadFromBytes(decoder, bytes, bits, payload);
+}
+
+int RFControl::decodePackedPairs(const RFPairDecoder *decoder, const RFPackedTimings *message, uint64_t *payload) {
+  uint8_t bytes[8];
+  int bits = decodePairBits(decoder, 0, message->data, 0, message->size, bytes, sizeof(bytes));
+  return payloadFromBytes(decoder, bytes, bits, payload);
+}
+
+/* Bucket ratios relative to the shortest bucket, in quarters. This is
+   independent of the oscillator speed of the transmitter.
+ */
+void bucketRatios(const unsigned int buckets[8], uint16_t ratios[8]) {
+  unsigned int shortest = 0;
+  for (int j = 0; j < 8; j++) {
+    if (buckets[j] != 0 && (shortest == 0 || buckets[j] < shortest)) {
+      shortest = buckets[j];
+    }
+  }
+  for (int j = 0; j < 8; j++) {
+    ratios[j] = shortest ? (4UL * buckets[j] + shortest / 2) / shortest : 0;
+  }
+}
+
+/* compressTimings() numbers the buckets in the order their pulses
+   first appear, which depends on the edge the capture started at.
+   rank[j] is the position of bucket j when the used buckets are sorted
+   by length, shortest first, and sorted receives them in that order
+   with the unused buckets last. Equal buckets keep their order.
+ */
+void rankBuckets(const unsigned int buckets[8], uint8_t rank[8], unsigned int sorted[8]) {
+  for (int j = 0; j < 8; j++) {
+    byte r = 0;
+    for (int k = 0; k < 8; k++) {
+      // Unused buckets sort after every used one
+      unsigned int a = buckets[k] ? buckets[k] : ~0U;
+      unsigned int b = buckets[j] ? buckets[j] : ~0U;
+      if (a < b || (a == b && k < j)) {
+        r++;
       }
-      // some delay between the message in air and the new message send
-      // there could be additional repeats following so wait some more time
-      if(streak == 0) {
-        waited += periodTime * MAX_PULSE_PERIODS;
-        hw_delayMicroseconds(periodTime * MAX_PULSE_PERIODS);
+    }
+    rank[j] = r;
+    sorted[r] = buckets[j];
+  }
+}
+
+/* Searches the protocol table for the first protocol with the same
+   message size and bucket ratios within 25% that decodes without
+   errors. The longest bucket is the sync, which only has to be at
+   least 25% below its ratio since the last frame of a burst is
+   followed by a longer gap. The table is read with hw_readProgmem().
+ */
+int matchProtocolTable(const RFProtocol *protocols, unsigned int protocols_count, const unsigned int buckets[8], const unsigned int *timings, const uint8_t *packed, unsigned int timings_size, uint64_t *payload) {
+  uint8_t rank[8];
+  unsigned int sorted[8];
+  rankBuckets(buckets, rank, sorted);
+  uint16_t ratios[8];
+  bucketRatios(sorted, ratios);
+  for (unsigned int p = 0; p < protocols_count; p++) {
+    RFProtocol protocol;
+    hw_readProgmem(&protocol, &protocols[p], sizeof(RFProtocol));
+    if (protocol.size != 0 && protocol.size != timings_size) {
+      continue;
+    }
+    int j = 0;
+    for (; j < 8; j++) {
+      uint16_t expected = protocol.ratios[j];
+      uint16_t delta = expected / 4;
+      bool sync = expected != 0 && (j == 7 || protocol.ratios[j + 1] == 0);
+      if (ratios[j] + delta < expected || (!sync && ratios[j] > expected + delta)) {
+        break;
       }
     }
+    if (j < 8) {
+      continue;
+    }
+    uint8_t bytes[8];
+    int bits = decodePairBits(&protocol.decoder, timings, packed, rank, timings_size, bytes, sizeof(bytes));
+    if (bits >= 0) {
+      payloadFromBytes(&protocol.decoder, bytes, bits, payload);
+      return protocol.id;
+    }
+  }
+  return -1;
+}
+
+int RFControl::matchProtocol(const RFProtocol *protocols, unsigned int protocols_count, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size, uint64_t *payload) {
+  return matchProtocolTable(protocols, protocols_count, buckets, timings, 0, timings_size, payload);
+}
+
+int RFControl::matchPackedProtocol(const RFProtocol *protocols, unsigned int protocols_count, const RFPackedTimings *message, uint64_t *payload) {
+  return matchProtocolTable(protocols, protocols_count, message->buckets, 0, message->data, message->size, payload);
+}
+
+// 32 bit FNV-1a
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME 16777619UL
+
+static inline uint32_t fnv(uint32_t hash, uint8_t val) {
+  return (hash ^ val) * FNV_PRIME;
+}
+
+/* Rounds 4 * log2(ratio) to an integer, ratio in 1/16 units. The
+   mantissa thresholds are 2^(1/8), 2^(3/8), 2^(5/8) and 2^(7/8).
+ */
+uint8_t logRatio(unsigned long ratio) {
+  if (ratio == 0) {
+    return 0;
+  }
+  byte msb = 0;
+  while ((ratio >> msb) > 1) {
+    msb++;
+  }
+  unsigned int mant = msb >= 7 ? ratio >> (msb - 7) : ratio << (7 - msb);
+  byte step = mant >= 235 ? 4 : mant >= 197 ? 3 : mant >= 166 ? 2 : mant >= 140 ? 1 : 0;
+  return 4 * (msb - 4) + step + 1;
+}
+
+void finishSignature(RFSignature *signature, const unsigned int buckets[8], unsigned int timings_size) {
+  unsigned int shortest = 0;
+  for (int j = 0; j < 8; j++) {
+    if (buckets[j] != 0 && (shortest == 0 || buckets[j] < shortest)) {
+      shortest = buckets[j];
+    }
+  }
+  uint32_t key = signature->hash;
+  for (int j = 0; j < 8; j++) {
+    signature->ratios[j] = shortest ? logRatio(16UL * buckets[j] / shortest) : 0;
+    key = fnv(key, signature->ratios[j]);
+  }
+  signature->size = timings_size;
+  key = fnv(key, timings_size & 0xff);
+  signature->key = fnv(key, timings_size >> 8);
+}
+
+/* Signature of unpacked indices or a packed message. The indices are
+   hashed in rankBuckets() order, so the hash does not depend on the
+   pulse the capture started with. The last pulse is the sync, whose
+   length depends on what follows the message, e.g. the gap after the
+   last frame of a burst. Unless other pulses share its bucket it is
+   left out of the ratios.
+ */
+void signMessage(RFSignature *signature, const unsigned int buckets[8], const unsigned int *timings, const uint8_t *packed, unsigned int timings_size) {
+  uint8_t rank[8];
+  unsigned int sorted[8];
+  rankBuckets(buckets, rank, sorted);
+  byte sync = 0;
+  if (timings_size > 0) {
+    sync = packed ? RFControl::getPackedIndex(packed, timings_size - 1) : timings[timings_size - 1] & 7;
+  }
+  bool shared = false;
+  uint32_t hash = FNV_OFFSET;
+  for (unsigned int i = 0; i < timings_size; i++) {
+    byte index = packed ? RFControl::getPackedIndex(packed, i) : timings[i] & 7;
+    shared |= i + 1 < timings_size && index == sync;
+    hash = fnv(hash, rank[index]);
+  }
+  if (timings_size > 0 && !shared) {
+    sorted[rank[sync]] = 0;
+  }
+  signature->hash = hash;
+  finishSignature(signature, sorted, timings_size);
+}
+
+void RFControl::computeSignature(RFSignature *signature, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size) {
+  signMessage(signature, buckets, timings, 0, timings_size);
+}
+
+void RFControl::computePackedSignature(RFSignature *signature, const RFPackedTimings *message) {
+  signMessage(signature, message->buckets, 0, message->data, message->size);
+}
+
+/* Carrier sense. The channel is busy while the receiver is in the
+   middle of a message, and stays reserved for the sync gap plus
+   MAX_PULSE_PERIODS periods after it since repeats may follow. Returns how long to wait
+   before checking again, 0 if the channel is clear. While a message is
+   in the air the wait is a random backoff that doubles with each
+   attempt, the isr sets channelEvent when the message ends so waiting
+   senders can check again right away.
+ */
+unsigned long channelWait(unsigned long now, byte *attempt) {
+  unsigned long guard = ((unsigned long)activityPeriod * MAX_PULSE_PERIODS + activityGap) * PULSE_LENGTH_DIVIDER;
+  unsigned long idle = now - lastActivity;
+  if (interruptPin == -1 || idle >= guard) {
+    return 0;
+  }
+  if (streak > CARRIER_MIN_STREAK) {
+    unsigned long window = guard << *attempt;
+    if (*attempt < CSMA_MAX_BACKOFF) {
+      (*attempt)++;
+    }
+    return 1 + hw_random(window);
+  }
+  return guard - idle;
+}
+
+void recordWait(unsigned long waited, bool deferred, bool timeout) {
+  txStats.sends++;
+  if (deferred) {
+    txStats.deferred++;
+  }
+  if (timeout) {
+    txStats.timeouts++;
+  }
+  txStats.waitMicros += waited;
+  if (waited > txStats.maxWaitMicros) {
+    txStats.maxWaitMicros = waited;
+  }
+}
+
+void listenBeforeTalk()
+{
+  unsigned long start = hw_micros();
+  byte attempt = 0;
+  bool deferred = false;
+  bool timeout = false;
+  for (;;) {
+    unsigned long now = hw_micros();
+    if (now - start > CSMA_TIMEOUT) {
+      timeout = true;
+      break;
+    }
+    unsigned long wait = channelWait(now, &attempt);
+    if (wait == 0) {
+      break;
+    }
+    deferred = true;
+    channelEvent = false;
+    while (hw_micros() - now < wait && !channelEvent) {
+    }
+  }
+  recordWait(hw_micros() - start, deferred, timeout);
+  if(interruptPin != -1 && !echoWindow) {
     // stop receiving while sending, this method preserves the recording state
     hw_detachInterrupt(interruptPin);   
   }
 }
 
+void RFControl::getTransmitStats(RFTransmitStats *stats) {
+  hw_noInterrupts();
+  *stats = txStats;
+  hw_interrupts();
+}
+
+void RFControl::resetTransmitStats() {
+  hw_noInterrupts();
+  memset(&txStats, 0, sizeof(txStats));
+  hw_interrupts();
+}
+
+/* Keeps the receiver running while sending. Edges that follow one of
+   our own within echoWindow micros are taken as the echo of the
+   transmitter and dropped, other edges are received as usual so
+   answers sent right after our message are not lost.
+ */
+void RFControl::enableReceiveWhileSending(unsigned int _echoWindow) {
+  hw_noInterrupts();
+  lastTxEdge = hw_micros() - _echoWindow;
+  echoWindow = _echoWindow;
+  hw_interrupts();
+}
+
+void RFControl::disableReceiveWhileSending() {
+  echoWindow = 0;
+}
+
+/* Remembers the time of a transmitted edge for the echo check of the
+   isr. fromMain is false when called from the transmitter interrupt,
+   otherwise interrupts are disabled so the isr never reads a partly
+   written time.
+ */
+void markTxEdge(bool fromMain) {
+  if (echoWindow) {
+    unsigned long now = hw_micros();
+    if (fromMain) {
+      hw_noInterrupts();
+    }
+    lastTxEdge = now;
+    if (fromMain) {
+      hw_interrupts();
+    }
+  }
+}
+
 void afterTalk()
 {
   // enable reciving again
@@ -377,39 +1007,713 @@ void afterTalk()
 }
 
 
-void RFControl::sendByCompressedTimings(int transmitterPin,unsigned long* buckets, char* compressTimings, unsigned int repeats) {
-  listenBeforeTalk();
-  unsigned int timings_size = strlen(compressTimings);
+#define TX_TIMINGS 0
+#define TX_COMPRESSED 1
+#define TX_PACKED 2
+#define TX_PROGRAM 3
+#define TX_FLASH 4
+#define TX_INDICES 5
+#define TX_BURST 6
+
+// A message to transmit, data and buckets depend on type
+struct TxSource {
+  byte type;
+  unsigned int size;
+  const void *data;
+  const void *buckets;
+};
+
+// getPackedIndex() for packed indices in PROGMEM
+uint8_t getFlashIndex(const uint8_t *packed, unsigned int i) {
+  unsigned int bit = i * 3;
+  byte shift = bit & 7;
+  unsigned int val = hw_readProgmemByte(&packed[bit >> 3]) >> shift;
+  if (shift > 5) {
+    val |= hw_readProgmemByte(&packed[(bit >> 3) + 1]) << (8 - shift);
+  }
+  return val & 7;
+}
+
+unsigned long sourceDuration(const TxSource &source, unsigned int j) {
+  switch (source.type) {
+    case TX_COMPRESSED:
+      return ((const unsigned long*)source.buckets)[((const char*)source.data)[j] - '0'];
+    case TX_PACKED: {
+      const RFPackedTimings *packed = (const RFPackedTimings*)source.data;
+      return (unsigned long)packed->buckets[RFControl::getPackedIndex(packed->data, j)] * PULSE_LENGTH_DIVIDER;
+    }
+    case TX_INDICES:
+      return (unsigned long)((const unsigned int*)source.buckets)[((const unsigned int*)source.data)[j]] * PULSE_LENGTH_DIVIDER;
+    case TX_FLASH:
+      return (unsigned long)hw_readProgmemWord(&((const uint16_t*)source.buckets)[getFlashIndex((const uint8_t*)source.data, j)]) * PULSE_LENGTH_DIVIDER;
+    case TX_PROGRAM:
+      return (((const RFTxProgram*)source.data)->ticks[j] & ~RF_PROGRAM_HOLD) / HW_TICKS_PER_US;
+    default:
+      return ((const unsigned int*)source.data)[j];
+  }
+}
+
+/* The frame to send in repeat i. Bursts pick their frame and let the
+   caller change it here, other sources send the same frame each time.
+ */
+TxSource repeatSource(const TxSource &source, unsigned int i) {
+  if (source.type != TX_BURST) {
+    return source;
+  }
+  const RFTransmission *burst = (const RFTransmission*)source.data;
+  RFPackedTimings *frame = &burst->frames[i % burst->frames_count];
+  if (burst->beforeRepeat) {
+    burst->beforeRepeat(frame, i);
+  }
+  TxSource result = { TX_PACKED, frame->size, frame, 0 };
+  return result;
+}
+
+unsigned long repeatGap(const TxSource &source) {
+  return source.type == TX_BURST ? ((const RFTransmission*)source.data)->gap : 0;
+}
+
+// Time hw_digitalWrite() takes, see calibrateTransmitter()
+unsigned int writeOverhead = 0;
+
+// Writes timed by calibrateTransmitter()
+#define CALIBRATION_WRITES 64
+
+/* Measures how long hw_digitalWrite() and the loop around it take on
+   this board and clock, and stores it as compensation for the blocking
+   transmitter. The pin is held low. Returns the overhead in micros.
+ */
+unsigned int RFControl::calibrateTransmitter(int transmitterPin) {
   hw_pinMode(transmitterPin, OUTPUT);
-  for(unsigned int i = 0; i < repeats; i++) {
+  unsigned long start = hw_micros();
+  for (byte i = 0; i < CALIBRATION_WRITES; i++) {
     hw_digitalWrite(transmitterPin, LOW);
-    int state = LOW;
-    for(unsigned int j = 0; j < timings_size; j++) {
-      state = !state;
-      hw_digitalWrite(transmitterPin, state);
-      unsigned int index = compressTimings[j] - '0';
-      hw_delayMicroseconds(buckets[index]);
+  }
+  unsigned long elapsed = hw_micros() - start;
+  writeOverhead = (elapsed + CALIBRATION_WRITES / 2) / CALIBRATION_WRITES;
+  return writeOverhead;
+}
+
+// Sets a compensation measured before, e.g. stored in EEPROM
+void RFControl::setTransmitterOverhead(unsigned int micros) {
+  writeOverhead = micros;
+}
+
+/* Waits until hw_micros() reaches deadline. Edges are scheduled at
+   absolute times from the start of the transmission, so the time
+   spent in hw_digitalWrite() and the loop does not add up over the
+   frame.
+ */
+void waitUntil(unsigned long deadline) {
+  long remaining = (long)(deadline - hw_micros());
+  if (remaining > 16) {
+    // Sleep through most of long pulses
+    hw_delayMicroseconds(remaining - 16);
+  }
+  while ((long)(deadline - hw_micros()) > 0) {
+  }
+}
+
+/* Each write is started writeOverhead micros before its deadline, so
+   that the edge lands on it.
+ */
+void sendBlocking(int transmitterPin, const TxSource &source, unsigned int repeats) {
+  hw_pinMode(transmitterPin, OUTPUT);
+  hw_digitalWrite(transmitterPin, LOW);
+  int state = LOW;
+  // Start a little ahead so the first edge is timed like the others
+  unsigned long deadline = hw_micros() + writeOverhead + 8;
+  unsigned long gap = repeatGap(source);
+  TxSource frame = repeatSource(source, 0);
+  for(unsigned int i = 0; i < repeats; i++) {
+    if (state != LOW) {
+      // Frames with an odd number of pulses start low again once their
+      // last pulse is over
+      waitUntil(deadline - writeOverhead);
+      state = LOW;
+      hw_digitalWrite(transmitterPin, LOW);
+      markTxEdge(true);
+    }
+    for(unsigned int j = 0; j < frame.size; j++) {
+      if (frame.type == TX_PROGRAM) {
+        // Compiled programs write the port directly, as in txTick()
+        const RFTxProgram *program = (const RFTxProgram*)frame.data;
+        if (!(program->ticks[j] & RF_PROGRAM_HOLD)) {
+          waitUntil(deadline - writeOverhead);
+          state = !state;
+          hw_noInterrupts();
+          hw_portWrite(program->port, program->mask, state);
+          hw_interrupts();
+          markTxEdge(true);
+        }
+      }
+      else {
+        waitUntil(deadline - writeOverhead);
+        state = !state;
+        hw_digitalWrite(transmitterPin, state);
+        markTxEdge(true);
+      }
+      deadline += sourceDuration(frame, j);
+    }
+    if (i + 1 < repeats && source.type == TX_BURST) {
+      // Prepare the next frame during the last pulse
+      frame = repeatSource(source, i + 1);
+      waitUntil(deadline - writeOverhead);
+      if (state != LOW) {
+        state = LOW;
+        hw_digitalWrite(transmitterPin, LOW);
+        markTxEdge(true);
+      }
+      deadline += gap;
     }
   }
+  waitUntil(deadline - writeOverhead);
   hw_digitalWrite(transmitterPin, LOW);
+  markTxEdge(true);
+}
+
+void RFControl::sendByCompressedTimings(int transmitterPin,unsigned long* buckets, char* compressTimings, unsigned int repeats) {
+  listenBeforeTalk();
+  TxSource source = { TX_COMPRESSED, (unsigned int)strlen(compressTimings), compressTimings, buckets };
+  sendBlocking(transmitterPin, source, repeats);
   afterTalk();
 }
 
+/* Sends the output of compressTimings() as it is, timings holds the
+   bucket indices and buckets is in getRaw() units.
+ */
+void RFControl::sendByCompressedTimings(int transmitterPin, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size, unsigned int repeats) {
+  listenBeforeTalk();
+  TxSource source = { TX_INDICES, timings_size, timings, buckets };
+  sendBlocking(transmitterPin, source, repeats);
+  afterTalk();
+}
 
 void RFControl::sendByTimings(int transmitterPin, unsigned int *timings, unsigned int timings_size, unsigned int repeats) {
   listenBeforeTalk();
+  TxSource source = { TX_TIMINGS, timings_size, timings, 0 };
+  sendBlocking(transmitterPin, source, repeats);
+  afterTalk();
+}
 
-  hw_pinMode(transmitterPin, OUTPUT);
-  for(unsigned int i = 0; i < repeats; i++) {
-    hw_digitalWrite(transmitterPin, LOW);
-    int state = LOW;
-    for(unsigned int j = 0; j < timings_size; j++) {
-      state = !state;
-      hw_digitalWrite(transmitterPin, state);
-      hw_delayMicroseconds(timings[j]);
+void RFControl::sendByPackedTimings(int transmitterPin, const RFPackedTimings *message, unsigned int repeats) {
+  listenBeforeTalk();
+  TxSource source = { TX_PACKED, message->size, message, 0 };
+  sendBlocking(transmitterPin, source, repeats);
+  afterTalk();
+}
+
+/* Sends a packed message stored in PROGMEM, buckets and packed are
+   flash addresses and nothing is copied to RAM. The buckets are in
+   getRaw() units like RFPackedTimings.
+ */
+void RFControl::sendByFlashTimings(int transmitterPin, const uint16_t *buckets, const uint8_t *packed, unsigned int timings_size, unsigned int repeats) {
+  listenBeforeTalk();
+  TxSource source = { TX_FLASH, timings_size, packed, buckets };
+  sendBlocking(transmitterPin, source, repeats);
+  afterTalk();
+}
+
+void RFControl::sendTransmission(const RFTransmission *transmission) {
+  listenBeforeTalk();
+  TxSource source = { TX_BURST, transmission->frames_count, transmission, 0 };
+  sendBlocking(transmission->pin, source, transmission->repeats);
+  afterTalk();
+}
+
+/* Asynchronous transmitter. Each edge is written from the timer
+   callback, which then schedules the next edge, so the caller returns
+   while carrier sense and the frames run from interrupts.
+   Pulses longer than the timer can handle are split in several waits.
+ */
+volatile bool txBusy = false;
+int txPin;
+TxSource txSource;
+// The frame of the current repeat
+TxSource txFrame;
+unsigned int txRepeats;
+// Callbacks of sendAsync() and of queued entries, only one is set
+void (*txDone)(void);
+void (*txQueueDone)(int id);
+
+// Transmitter state
+unsigned int txEdge;
+unsigned int txRepeat;
+byte txState;
+unsigned long txRemaining;
+
+// Transmit queue
+#ifndef TX_QUEUE_SIZE
+#define TX_QUEUE_SIZE 8
+#endif
+
+struct TxEntry {
+  TxSource source;
+  int pin;
+  unsigned int repeats;
+  byte priority;
+  unsigned long notBefore;
+  void (*done)(int id);
+  uint16_t id;
+  bool used;
+};
+TxEntry txQueue[TX_QUEUE_SIZE];
+
+/* Id of the next queued entry and of the entry being sent. Ids are 15
+   bits so they stay positive in an int on every board and only repeat
+   after 32768 queued messages.
+ */
+#define TX_ID_MASK 0x7fff
+uint16_t txNextId = 0;
+volatile int txCurrentId = -1;
+
+// The timer is waiting for the send time of a queued entry
+volatile bool txWaking = false;
+
+// The send is waiting for the channel
+volatile bool txSensing = false;
+byte txAttempt;
+bool txDeferred;
+unsigned long txSenseStart;
+
+void txSense();
+
+void queueNext();
+
+unsigned long txDuration(unsigned int j) {
+  return sourceDuration(txFrame, j);
+}
+
+void txFinish() {
+  int id = txCurrentId;
+  txBusy = false;
+  txCurrentId = -1;
+  if (txDone) {
+    txDone();
+  }
+  if (txQueueDone) {
+    txQueueDone(id);
+  }
+}
+
+#if HW_HAS_TIMER
+void txWait() {
+  unsigned long delay = txRemaining > HW_TIMER_MAX_DELAY ? HW_TIMER_MAX_DELAY : txRemaining;
+  txRemaining -= delay;
+  hw_timerSchedule(delay);
+}
+
+void txTick() {
+  if (txRemaining > 0) {
+    txWait();
+    return;
+  }
+  if (txWaking) {
+    txWaking = false;
+    hw_timerStop();
+    queueNext();
+    return;
+  }
+  if (txSensing) {
+    txSense();
+    return;
+  }
+  if (txEdge == txFrame.size) {
+    if (++txRepeat >= txRepeats) {
+      hw_digitalWrite(txPin, LOW);
+      markTxEdge(false);
+      hw_timerStop();
+      afterTalk();
+      txFinish();
+      queueNext();
+      return;
+    }
+    txEdge = 0;
+    if (txState != LOW && txSource.type != TX_BURST) {
+      // Frames with an odd number of pulses start low again, like in
+      // sendBlocking()
+      hw_digitalWrite(txPin, LOW);
+      markTxEdge(false);
+    }
+    txState = LOW;
+    if (txSource.type == TX_BURST) {
+      hw_digitalWrite(txPin, LOW);
+      markTxEdge(false);
+      txFrame = repeatSource(txSource, txRepeat);
+      txRemaining = repeatGap(txSource);
+      if (txRemaining > 0) {
+        txWait();
+        return;
+      }
     }
   }
-  hw_digitalWrite(transmitterPin, LOW);
+  if (txFrame.type == TX_PROGRAM) {
+    const RFTxProgram *program = (const RFTxProgram*)txFrame.data;
+    uint16_t ticks = program->ticks[txEdge++];
+    if (!(ticks & RF_PROGRAM_HOLD)) {
+      txState = !txState;
+      hw_portWrite(program->port, program->mask, txState);
+      markTxEdge(false);
+    }
+    hw_timerScheduleTicks(ticks & ~RF_PROGRAM_HOLD);
+    return;
+  }
+  txState = !txState;
+  hw_digitalWrite(txPin, txState);
+  markTxEdge(false);
+  txRemaining = txDuration(txEdge++);
+  txWait();
+}
+#endif
+
+void txBegin() {
+  hw_pinMode(txPin, OUTPUT);
+  hw_digitalWrite(txPin, LOW);
+#if HW_HAS_TIMER
+  txEdge = 0;
+  txRepeat = 0;
+  txState = LOW;
+  txRemaining = 0;
+  txFrame = repeatSource(txSource, 0);
+  hw_timerStart(txTick);
+  txTick();
+#else
+  // No timer on this platform, send blocking
+  sendBlocking(txPin, txSource, txRepeats);
   afterTalk();
+  txFinish();
+#endif
+}
+
+#if HW_HAS_TIMER
+/* Carrier sense for asynchronous sends, the timer and channel events
+   from the isr call this until the channel is clear.
+ */
+void txSense() {
+  unsigned long now = hw_micros();
+  bool timeout = now - txSenseStart > CSMA_TIMEOUT;
+  unsigned long wait = timeout ? 0 : channelWait(now, &txAttempt);
+  if (wait > 0) {
+    txDeferred = true;
+    txRemaining = wait;
+    hw_timerStart(txTick);
+    txWait();
+    // Only now may channel events from the isr restart carrier sense
+    txSensing = true;
+    return;
+  }
+  txSensing = false;
+  recordWait(now - txSenseStart, txDeferred, timeout);
+  if (interruptPin != -1 && !echoWindow) {
+    hw_detachInterrupt(interruptPin);
+  }
+  txBegin();
+}
+
+void txChannelEvent() {
+  if (txSensing) {
+    txSense();
+  }
+}
+#else
+void txChannelEvent() {
+}
+#endif
+
+void startAsync() {
+  if (txSource.size == 0 || txRepeats == 0) {
+    txFinish();
+    return;
+  }
+#if HW_HAS_TIMER
+  txAttempt = 0;
+  txDeferred = false;
+  txSenseStart = hw_micros();
+  txSense();
+#else
+  listenBeforeTalk();
+  txBegin();
+#endif
+}
+
+bool sendSource(int transmitterPin, const TxSource &source, unsigned int repeats, void (*done)(void)) {
+  hw_noInterrupts();
+  if (txBusy || txWaking) {
+    hw_interrupts();
+    return false;
+  }
+  txBusy = true;
+  hw_interrupts();
+  txPin = transmitterPin;
+  txSource = source;
+  txRepeats = repeats;
+  txDone = done;
+  txQueueDone = 0;
+  startAsync();
+  return true;
+}
+
+bool RFControl::sendAsync(int transmitterPin, unsigned int *timings, unsigned int timings_size, unsigned int repeats, void (*done)(void)) {
+  TxSource source = { TX_TIMINGS, timings_size, timings, 0 };
+  return sendSource(transmitterPin, source, repeats, done);
+}
+
+bool RFControl::sendAsync(int transmitterPin, unsigned long* buckets, char* compressTimings, unsigned int repeats, void (*done)(void)) {
+  TxSource source = { TX_COMPRESSED, (unsigned int)strlen(compressTimings), compressTimings, buckets };
+  return sendSource(transmitterPin, source, repeats, done);
+}
+
+bool RFControl::sendAsync(int transmitterPin, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size, unsigned int repeats, void (*done)(void)) {
+  TxSource source = { TX_INDICES, timings_size, timings, buckets };
+  return sendSource(transmitterPin, source, repeats, done);
+}
+
+bool RFControl::sendAsync(int transmitterPin, const RFPackedTimings *message, unsigned int repeats, void (*done)(void)) {
+  TxSource source = { TX_PACKED, message->size, message, 0 };
+  return sendSource(transmitterPin, source, repeats, done);
+}
+
+bool RFControl::sendFlashAsync(int transmitterPin, const uint16_t *buckets, const uint8_t *packed, unsigned int timings_size, unsigned int repeats, void (*done)(void)) {
+  TxSource source = { TX_FLASH, timings_size, packed, buckets };
+  return sendSource(transmitterPin, source, repeats, done);
+}
+
+/* Sends a burst of repeats as described by transmission, see
+   RFTransmission. The descriptor and its frames must stay valid until
+   the send is done.
+ */
+bool RFControl::sendTransmissionAsync(const RFTransmission *transmission, void (*done)(void)) {
+  TxSource source = { TX_BURST, transmission->frames_count, transmission, 0 };
+  return sendSource(transmission->pin, source, transmission->repeats, done);
+}
+
+bool RFControl::isSending() {
+  return txBusy;
+}
+
+/* Starts the queued entry with the highest priority whose send time
+   has come, oldest first among equal priorities. If every entry has to
+   wait, the timer wakes the transmitter at the earliest send time.
+   fromMain is false when called from the transmitter interrupt.
+ */
+void pickNext(bool fromMain) {
+  if (fromMain) {
+    hw_noInterrupts();
+  }
+  if (txBusy || txWaking) {
+    if (fromMain) {
+      hw_interrupts();
+    }
+    return;
+  }
+  unsigned long now = hw_micros();
+  int best = -1;
+  long wait = 0;
+  for (int i = 0; i < TX_QUEUE_SIZE; i++) {
+    TxEntry *entry = &txQueue[i];
+    if (!entry->used) {
+      continue;
+    }
+    long until = (long)(entry->notBefore - now);
+    if (entry->notBefore != 0 && until > 0) {
+      if (wait == 0 || until < wait) {
+        wait = until;
+      }
+      continue;
+    }
+    if (best == -1 || entry->priority > txQueue[best].priority ||
+        (entry->priority == txQueue[best].priority && ((entry->id - txQueue[best].id) & TX_ID_MASK) > TX_ID_MASK / 2)) {
+      best = i;
+    }
+  }
+  if (best != -1) {
+    TxEntry *entry = &txQueue[best];
+    entry->used = false;
+    txBusy = true;
+    txCurrentId = entry->id;
+    txPin = entry->pin;
+    txSource = entry->source;
+    txRepeats = entry->repeats;
+    txDone = 0;
+    txQueueDone = entry->done;
+    if (fromMain) {
+      hw_interrupts();
+    }
+    startAsync();
+    return;
+  }
+#if HW_HAS_TIMER
+  if (wait > 0) {
+    txWaking = true;
+    txRemaining = wait;
+    hw_timerStart(txTick);
+    txWait();
+  }
+#endif
+  if (fromMain) {
+    hw_interrupts();
+  }
 }
 
+void queueNext() {
+  pickNext(false);
+}
+
+int queueSource(int transmitterPin, const TxSource &source, unsigned int repeats, byte priority, unsigned long notBefore, void (*done)(int id)) {
+  int id = -1;
+  hw_noInterrupts();
+  for (int i = 0; i < TX_QUEUE_SIZE; i++) {
+    TxEntry *entry = &txQueue[i];
+    if (entry->used && entry->pin == transmitterPin && entry->source.type == source.type &&
+        entry->source.data == source.data && entry->source.buckets == source.buckets && entry->done == done &&
+        entry->notBefore == notBefore) {
+      // Same message already waiting, send it once with all repeats
+      entry->repeats += repeats;
+      if (priority > entry->priority) {
+        entry->priority = priority;
+      }
+      id = entry->id;
+      break;
+    }
+  }
+  for (int i = 0; id == -1 && i < TX_QUEUE_SIZE; i++) {
+    TxEntry *entry = &txQueue[i];
+    if (!entry->used) {
+      entry->source = source;
+      entry->pin = transmitterPin;
+      entry->repeats = repeats;
+      entry->priority = priority;
+      entry->notBefore = notBefore;
+      entry->done = done;
+      entry->id = txNextId;
+      txNextId = (txNextId + 1) & TX_ID_MASK;
+      entry->used = true;
+      id = entry->id;
+    }
+  }
+#if HW_HAS_TIMER
+  if (txWaking) {
+    // The new entry may be due before the pending wake up
+    hw_timerStop();
+    txWaking = false;
+    txRemaining = 0;
+  }
+#endif
+  hw_interrupts();
+  RFControl::processTransmitQueue();
+  return id;
+}
+
+/* Queued messages are sent back to back by the transmitter, the
+   queue returns an id that can be passed to isQueued() and that done
+   gets when the message has been sent. A message that is already
+   waiting in the queue for the same notBefore is not added again, its
+   repeats are added to the waiting entry instead. notBefore is a
+   hw_micros() time, 0 sends as soon as possible. On boards without a timer, call
+   processTransmitQueue() from loop() to send them.
+ */
+int RFControl::queueSend(int transmitterPin, unsigned int *timings, unsigned int timings_size, unsigned int repeats, uint8_t priority, unsigned long notBefore, void (*done)(int id)) {
+  TxSource source = { TX_TIMINGS, timings_size, timings, 0 };
+  return queueSource(transmitterPin, source, repeats, priority, notBefore, done);
+}
+
+int RFControl::queueSend(int transmitterPin, unsigned long* buckets, char* compressTimings, unsigned int repeats, uint8_t priority, unsigned long notBefore, void (*done)(int id)) {
+  TxSource source = { TX_COMPRESSED, (unsigned int)strlen(compressTimings), compressTimings, buckets };
+  return queueSource(transmitterPin, source, repeats, priority, notBefore, done);
+}
+
+int RFControl::queueSend(int transmitterPin, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size, unsigned int repeats, uint8_t priority, unsigned long notBefore, void (*done)(int id)) {
+  TxSource source = { TX_INDICES, timings_size, timings, buckets };
+  return queueSource(transmitterPin, source, repeats, priority, notBefore, done);
+}
+
+int RFControl::queueSend(int transmitterPin, const RFPackedTimings *message, unsigned int repeats, uint8_t priority, unsigned long notBefore, void (*done)(int id)) {
+  TxSource source = { TX_PACKED, message->size, message, 0 };
+  return queueSource(transmitterPin, source, repeats, priority, notBefore, done);
+}
+
+bool RFControl::isQueued(int id) {
+  if (id == txCurrentId) {
+    return true;
+  }
+  for (int i = 0; i < TX_QUEUE_SIZE; i++) {
+    if (txQueue[i].used && txQueue[i].id == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RFControl::processTransmitQueue() {
+  pickNext(true);
+}
+
+/* Longest pulse stored in a single program entry. Within the limit of
+   the timer and below RF_PROGRAM_HOLD.
+ */
+#if HW_HAS_TIMER && HW_TIMER_MAX_DELAY * HW_TICKS_PER_US < 0x7fff
+#define PROGRAM_MAX_TICKS (HW_TIMER_MAX_DELAY * HW_TICKS_PER_US)
+#else
+#define PROGRAM_MAX_TICKS 0x7fff
+#endif
+
+bool compileSource(RFTxProgram *program, int transmitterPin, const TxSource &source, uint16_t *ticks, unsigned int ticks_size) {
+  program->pin = transmitterPin;
+  program->port = hw_pinPort(transmitterPin);
+  program->mask = hw_pinMask(transmitterPin);
+  program->ticks = ticks;
+  unsigned int size = 0;
+  for (unsigned int j = 0; j < source.size; j++) {
+    unsigned long remaining = sourceDuration(source, j) * HW_TICKS_PER_US;
+    uint16_t hold = 0;
+    do {
+      if (size == ticks_size) {
+        program->size = 0;
+        return false;
+      }
+      uint16_t chunk = remaining > PROGRAM_MAX_TICKS ? PROGRAM_MAX_TICKS : remaining;
+      ticks[size++] = chunk | hold;
+      remaining -= chunk;
+      hold = RF_PROGRAM_HOLD;
+    } while (remaining > 0);
+  }
+  program->size = size;
+  return true;
+}
+
+/* Compiles a message into a transmit program. ticks must have room for
+   at least one entry per pulse, plus one for each PROGRAM_MAX_TICKS of
+   long pulses. Returns false if it does not fit.
+ */
+bool RFControl::compileProgram(RFTxProgram *program, int transmitterPin, const unsigned int *timings, unsigned int timings_size, uint16_t *ticks, unsigned int ticks_size) {
+  TxSource source = { TX_TIMINGS, timings_size, timings, 0 };
+  return compileSource(program, transmitterPin, source, ticks, ticks_size);
+}
+
+bool RFControl::compileProgram(RFTxProgram *program, int transmitterPin, const unsigned long* buckets, const char* compressTimings, uint16_t *ticks, unsigned int ticks_size) {
+  TxSource source = { TX_COMPRESSED, (unsigned int)strlen(compressTimings), compressTimings, buckets };
+  return compileSource(program, transmitterPin, source, ticks, ticks_size);
+}
+
+bool RFControl::compileProgram(RFTxProgram *program, int transmitterPin, const RFPackedTimings *message, uint16_t *ticks, unsigned int ticks_size) {
+  TxSource source = { TX_PACKED, message->size, message, 0 };
+  return compileSource(program, transmitterPin, source, ticks, ticks_size);
+}
+
+bool RFControl::compileFlashProgram(RFTxProgram *program, int transmitterPin, const uint16_t *buckets, const uint8_t *packed, unsigned int timings_size, uint16_t *ticks, unsigned int ticks_size) {
+  TxSource source = { TX_FLASH, timings_size, packed, buckets };
+  return compileSource(program, transmitterPin, source, ticks, ticks_size);
+}
+
+bool RFControl::sendProgramAsync(const RFTxProgram *program, unsigned int repeats, void (*done)(void)) {
+  TxSource source = { TX_PROGRAM, program->size, program, 0 };
+  return sendSource(program->pin, source, repeats, done);
+}
+
+void RFControl::sendProgram(const RFTxProgram *program, unsigned int repeats) {
+  while (!sendProgramAsync(program, repeats)) {
+    // Wait for the previous transmission
+  }
+  while (txBusy) {
+  }
+}
@@ -4,6 +4,120 @@
 #ifndef ArduinoRf_h
 #define ArduinoRf_h
 
+#include <stdint.h>
+
+/* Compressed message with the bucket indices packed three bits per
+   pulse, least significant bit first. Buckets are in the same units as
+   getRaw(), i.e. divided by getPulseLengthDivider(). data must hold
+   at least getPackedSize(size) bytes.
+ */
+struct RFPackedTimings
+{
+  unsigned int buckets[8];
+  unsigned int size;
+  uint8_t *data;
+};
+
+/* Maps pairs of bucket indices to payload bits, e.g. the pairs "01"
+   -> 0 and "02" -> 1 are zero = RF_PAIR(0, 1) and one = RF_PAIR(0, 2).
+   header and footer are the number of pulses before and after the
+   payload pairs.
+ */
+#define RF_PAIR(first, second) (((first) << 3) | (second))
+#define RF_MSB_FIRST 0
+#define RF_LSB_FIRST 1
+
+struct RFPairDecoder
+{
+  uint8_t zero;
+  uint8_t one;
+  uint8_t header;
+  uint8_t footer;
+  uint8_t bitOrder;
+};
+
+/* Protocol descriptor for matchProtocol(), normally stored in PROGMEM.
+   ratios are the buckets sorted by length relative to the shortest
+   bucket in quarters, e.g. 4 for the shortest bucket itself and 0 for
+   unused buckets. The last one is the sync and matches any longer
+   gap. The decoder's pairs use the same sorted bucket numbers, like
+   compressTimingsAndSortBuckets(), whatever pulse the message starts
+   with. size is the number of pulses, 0 matches any length.
+ */
+struct RFProtocol
+{
+  uint8_t id;
+  uint16_t size;
+  uint16_t ratios[8];
+  RFPairDecoder decoder;
+};
+
+/* Canonical fingerprint of a compressed message. ratios are the
+   buckets sorted by length relative to the shortest bucket, which
+   removes the oscillator drift of the transmitter, rounded to a log
+   scale with four steps per octave so that jitter in long syncs does
+   not change the value. The sync at the end is left out, since the
+   last frame of a burst is followed by a longer gap. hash covers the
+   bucket index pattern in the same order and key combines all fields
+   for hash table lookup, so every repeat of a message has the same key
+   whatever pulse the capture started with.
+ */
+struct RFSignature
+{
+  uint8_t ratios[8];
+  uint16_t size;
+  uint32_t hash;
+  uint32_t key;
+};
+
+/* A message compiled for transmission by compileProgram(). port and
+   mask address the transmitter pin directly, ticks holds size pulse
+   durations in timer ticks. Entries with RF_PROGRAM_HOLD set continue
+   the previous pulse, which is how pulses longer than one timer period
+   are stored. A program can be sent any number of times.
+ */
+#define RF_PROGRAM_HOLD 0x8000
+
+struct RFTxProgram
+{
+  int pin;
+  void *port;
+  uint32_t mask;
+  unsigned int size;
+  uint16_t *ticks;
+};
+
+/* A burst of repeats sent as one transmission. Repeat i sends
+   frames[i % frames_count], after beforeRepeat(frame, i) has had the
+   chance to change it, e.g. to toggle a bit or count up a rolling code
+   with setPackedIndex(). The transmitter stays off for gap micros
+   between repeats. For asynchronous sends beforeRepeat is called from
+   the timer interrupt and has to be short.
+ */
+struct RFTransmission
+{
+  int pin;
+  RFPackedTimings *frames;
+  uint8_t frames_count;
+  unsigned int repeats;
+  unsigned long gap;
+  void (*beforeRepeat)(RFPackedTimings *frame, unsigned int repeat);
+};
+
+/* Transmit statistics from carrier sense. deferred counts sends that
+   found the channel busy, timeouts those that gave up waiting. echoes
+   counts received edges dropped as our own.
+ */
+struct RFTransmitStats
+{
+  unsigned long sends;
+  unsigned long deferred;
+  unsigned long timeouts;
+  unsigned long waitMicros;
+  unsigned long maxWaitMicros;
+  unsigned long echoes;
+};
+
 class RFControl
 {
   public:
@@ -13,10 +127,57 @@ class RFControl
     static bool hasData();
     static void getRaw(unsigned int **timings, unsigned int* timings_size);
     static void continueReceiving();
+    static void enableStreamCompression(uint8_t *buffer, unsigned int buffer_size);
+    static void disableStreamCompression();
+    static bool hasCompressedData();
+    static void getCompressed(RFPackedTimings *message);
+    static void continueCompressed();
     static bool compressTimings(unsigned int buckets[8], unsigned int *timings, unsigned int timings_size);
     static bool compressTimingsAndSortBuckets(unsigned int buckets[8], unsigned int *timings, unsigned int timings_size);
+    static unsigned int getPackedSize(unsigned int timings_size);
+    static void packTimings(unsigned int *timings, unsigned int timings_size, uint8_t *packed);
+    static uint8_t getPackedIndex(const uint8_t *packed, unsigned int i);
+    static void setPackedIndex(uint8_t *packed, unsigned int i, uint8_t index);
+    static bool compressTimingsPacked(RFPackedTimings *message, unsigned int *timings, unsigned int timings_size);
+    static void unpackTimings(const RFPackedTimings *message, unsigned int *timings);
+    static int decodePairs(const RFPairDecoder *decoder, const unsigned int *timings, unsigned int timings_size, uint64_t *payload);
+    static int decodePairsToBytes(const RFPairDecoder *decoder, const unsigned int *timings, unsigned int timings_size, uint8_t *payload, unsigned int payload_size);
+    static int decodePackedPairs(const RFPairDecoder *decoder, const RFPackedTimings *message, uint64_t *payload);
+    static int matchProtocol(const RFProtocol *protocols, unsigned int protocols_count, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size, uint64_t *payload);
+    static int matchPackedProtocol(const RFProtocol *protocols, unsigned int protocols_count, const RFPackedTimings *message, uint64_t *payload);
+    static void computeSignature(RFSignature *signature, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size);
+    static void computePackedSignature(RFSignature *signature, const RFPackedTimings *message);
     static void sendByTimings(int transmitterPin, unsigned int *timings, unsigned int timings_size, unsigned int repeats = 3);
     static void sendByCompressedTimings(int transmitterPin, unsigned long* buckets, char* compressTimings, unsigned int repeats = 3); 
+    static void sendByCompressedTimings(int transmitterPin, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size, unsigned int repeats = 3);
+    static void sendByPackedTimings(int transmitterPin, const RFPackedTimings *message, unsigned int repeats = 3);
+    static bool sendAsync(int transmitterPin, unsigned int *timings, unsigned int timings_size, unsigned int repeats = 3, void (*done)(void) = 0);
+    static bool sendAsync(int transmitterPin, unsigned long* buckets, char* compressTimings, unsigned int repeats = 3, void (*done)(void) = 0);
+    static bool sendAsync(int transmitterPin, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size, unsigned int repeats = 3, void (*done)(void) = 0);
+    static bool sendAsync(int transmitterPin, const RFPackedTimings *message, unsigned int repeats = 3, void (*done)(void) = 0);
+    static void sendByFlashTimings(int transmitterPin, const uint16_t *buckets, const uint8_t *packed, unsigned int timings_size, unsigned int repeats = 3);
+    static bool sendFlashAsync(int transmitterPin, const uint16_t *buckets, const uint8_t *packed, unsigned int timings_size, unsigned int repeats = 3, void (*done)(void) = 0);
+    static void sendTransmission(const RFTransmission *transmission);
+    static bool sendTransmissionAsync(const RFTransmission *transmission, void (*done)(void) = 0);
+    static bool isSending();
+    static unsigned int calibrateTransmitter(int transmitterPin);
+    static void setTransmitterOverhead(unsigned int micros);
+    static bool compileProgram(RFTxProgram *program, int transmitterPin, const unsigned int *timings, unsigned int timings_size, uint16_t *ticks, unsigned int ticks_size);
+    static bool compileProgram(RFTxProgram *program, int transmitterPin, const unsigned long* buckets, const char* compressTimings, uint16_t *ticks, unsigned int ticks_size);
+    static bool compileProgram(RFTxProgram *program, int transmitterPin, const RFPackedTimings *message, uint16_t *ticks, unsigned int ticks_size);
+    static bool compileFlashProgram(RFTxProgram *program, int transmitterPin, const uint16_t *buckets, const uint8_t *packed, unsigned int timings_size, uint16_t *ticks, unsigned int ticks_size);
+    static bool sendProgramAsync(const RFTxProgram *program, unsigned int repeats = 3, void (*done)(void) = 0);
+    static void sendProgram(const RFTxProgram *program, unsigned int repeats = 3);
+    static int queueSend(int transmitterPin, unsigned int *timings, unsigned int timings_size, unsigned int repeats = 3, uint8_t priority = 0, unsigned long notBefore = 0, void (*done)(int id) = 0);
+    static int queueSend(int transmitterPin, unsigned long* buckets, char* compressTimings, unsigned int repeats = 3, uint8_t priority = 0, unsigned long notBefore = 0, void (*done)(int id) = 0);
+    static int queueSend(int transmitterPin, const unsigned int buckets[8], const unsigned int *timings, unsigned int timings_size, unsigned int repeats = 3, uint8_t priority = 0, unsigned long notBefore = 0, void (*done)(int id) = 0);
+    static int queueSend(int transmitterPin, const RFPackedTimings *message, unsigned int repeats = 3, uint8_t priority = 0, unsigned long notBefore = 0, void (*done)(int id) = 0);
+    static bool isQueued(int id);
+    static void processTransmitQueue();
+    static void enableReceiveWhileSending(unsigned int echoWindow = 200);
+    static void disableReceiveWhileSending();
+    static void getTransmitStats(RFTransmitStats *stats);
+    static void resetTransmitStats();
     static unsigned int getLastDuration();
     static bool existNewDuration();
   private:
@@ -40,10 +40,201 @@ static inline void hw_pinMode(int pin, int mode) {
   pinMode(pin, mode);
 }
 
+static inline int hw_digitalRead(int pin) {
+  return digitalRead(pin);
+}
+
 static inline void hw_digitalWrite(int pin, int value) {
   digitalWrite(pin, value);
 }
 
+static inline void hw_readProgmem(void *dst, const void *src, size_t size) {
+  memcpy_P(dst, src, size);
+}
+
+static inline void hw_noInterrupts() {
+  noInterrupts();
+}
+
+static inline void hw_interrupts() {
+  interrupts();
+}
+
+static inline uint8_t hw_readProgmemByte(const void *src) {
+  return pgm_read_byte(src);
+}
+
+static inline uint16_t hw_readProgmemWord(const void *src) {
+  return pgm_read_word(src);
+}
+
+static inline uint32_t hw_random(uint32_t max) {
+  return random(max);
+}
+
 static inline uint32_t hw_micros() {
   return micros();
 }
+
+/* One shot timer for the asynchronous transmitter. hw_timerSchedule()
+   sets the next callback relative to the previous one, not to the time
+   of the call, so interrupt latency does not accumulate over a frame.
+   Delays must not exceed HW_TIMER_MAX_DELAY.
+ */
+#if defined(__AVR__) && defined(RF_CONTROL_USE_TIMER1)
+  /* Timer1 is shared with the Servo and TimerOne libraries and defining
+     its interrupt here would clash with them, so it is only used when
+     RF_CONTROL_USE_TIMER1 is set as a build flag for the whole project,
+     e.g. build_flags in platformio.ini. Otherwise asynchronous sends
+     block like on platforms without a timer. The control registers are
+     saved on start and restored on stop.
+   */
+  #if F_CPU % 8000000UL == 0
+    #define HW_TIMER_PRESCALER _BV(CS11)
+    #define HW_TIMER_TICKS_PER_US (F_CPU / 8000000UL)
+  #elif F_CPU % 1000000UL == 0
+    #define HW_TIMER_PRESCALER _BV(CS10)
+    #define HW_TIMER_TICKS_PER_US (F_CPU / 1000000UL)
+  #else
+    #error "RF_CONTROL_USE_TIMER1 needs F_CPU to be a whole number of MHz"
+  #endif
+  #define HW_HAS_TIMER 1
+  #define HW_TIMER_MAX_DELAY (30000 / HW_TIMER_TICKS_PER_US)
+
+  static void (*hw_timerCallback)(void);
+  static bool hw_timerActive;
+  static uint8_t hw_timerSavedA;
+  static uint8_t hw_timerSavedB;
+
+  ISR(TIMER1_COMPA_vect) {
+    hw_timerCallback();
+  }
+
+  static inline void hw_timerStart(void (*callback)(void)) {
+    hw_timerCallback = callback;
+    if (!hw_timerActive) {
+      hw_timerSavedA = TCCR1A;
+      hw_timerSavedB = TCCR1B;
+      hw_timerActive = true;
+    }
+    TCCR1A = 0;
+    TCCR1B = HW_TIMER_PRESCALER;
+    OCR1A = TCNT1;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 |= _BV(OCIE1A);
+  }
+
+  static inline void hw_timerSchedule(uint32_t delay) {
+    OCR1A += delay * HW_TIMER_TICKS_PER_US;
+    if ((int16_t)(OCR1A - TCNT1) < 8) {
+      // Deadline already passed, fire as soon as possible
+      OCR1A = TCNT1 + 8;
+    }
+  }
+
+  static inline void hw_timerStop() {
+    TIMSK1 &= ~_BV(OCIE1A);
+    if (hw_timerActive) {
+      TCCR1A = hw_timerSavedA;
+      TCCR1B = hw_timerSavedB;
+      hw_timerActive = false;
+    }
+  }
+
+  #define HW_TICKS_PER_US HW_TIMER_TICKS_PER_US
+
+  static inline void hw_timerScheduleTicks(uint16_t ticks) {
+    OCR1A += ticks;
+    if ((int16_t)(OCR1A - TCNT1) < 8) {
+      OCR1A = TCNT1 + 8;
+    }
+  }
+#elif defined(ESP8266)
+  // timer1 is single shot and relative to now, 5 ticks per us with
+  // TIM_DIV16. The deadline is tracked with micros() instead.
+  #define HW_HAS_TIMER 1
+  #define HW_TIMER_MAX_DELAY 1000000UL
+
+  static uint32_t hw_timerDeadline;
+
+  static inline void hw_timerStart(void (*callback)(void)) {
+    hw_timerDeadline = micros();
+    timer1_isr_init();
+    timer1_attachInterrupt(callback);
+    timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+  }
+
+  static inline void hw_timerSchedule(uint32_t delay) {
+    hw_timerDeadline += delay;
+    int32_t remaining = (int32_t)(hw_timerDeadline - micros());
+    timer1_write((remaining > 10 ? remaining : 10) * 5);
+  }
+
+  static inline void hw_timerStop() {
+    timer1_disable();
+    timer1_detachInterrupt();
+  }
+
+  #define HW_TICKS_PER_US 1
+
+  static inline void hw_timerScheduleTicks(uint16_t ticks) {
+    hw_timerSchedule(ticks);
+  }
+#else
+  #define HW_HAS_TIMER 0
+  #define HW_TICKS_PER_US 1
+#endif
+
+/* Direct port access for compiled transmit programs, the register and
+   bit of a pin are looked up once instead of in every digitalWrite().
+ */
+#if defined(__AVR__)
+  static inline void *hw_pinPort(int pin) {
+    return (void*)portOutputRegister(digitalPinToPort(pin));
+  }
+
+  static inline uint32_t hw_pinMask(int pin) {
+    return digitalPinToBitMask(pin);
+  }
+
+  // Called from the timer interrupt or with interrupts disabled, so the
+  // read-modify-write does not race other writes to the port
+  static inline void hw_portWrite(void *port, uint32_t mask, int value) {
+    if (value) {
+      *(volatile uint8_t*)port |= mask;
+    }
+    else {
+      *(volatile uint8_t*)port &= ~mask;
+    }
+  }
+#elif defined(ESP8266)
+  // Pins 0-15 are set and cleared through GPOS and GPOC
+  static inline void *hw_pinPort(int pin) {
+    return 0;
+  }
+
+  static inline uint32_t hw_pinMask(int pin) {
+    return 1UL << pin;
+  }
+
+  static inline void hw_portWrite(void *port, uint32_t mask, int value) {
+    if (value) {
+      GPOS = mask;
+    }
+    else {
+      GPOC = mask;
+    }
+  }
+#else
+  static inline void *hw_pinPort(int pin) {
+    return 0;
+  }
+
+  static inline uint32_t hw_pinMask(int pin) {
+    return pin;
+  }
+
+  static inline void hw_portWrite(void *port, uint32_t mask, int value) {
+    digitalWrite(mask, value);
+  }
+#endif
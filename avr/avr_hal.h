@@ -0,0 +1,103 @@
+#ifndef AVR_HAL_H
+#define AVR_HAL_H
+
+/* Platform functions for the AVR cycle benchmark, see bench.cpp.
+   RFControl.cpp includes this in place of arduino_functions.h when
+   built with -DRF_CONTROL_HAL='"avr_hal.h"' for a bare ATmega328P
+   without the Arduino core. The receiver isr is called directly by the
+   benchmark with a virtual clock and input level, like the simulator,
+   so its cost can be counted in cycles under simavr. Timer1 is used by
+   the benchmark and there is no transmitter.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+
+#define byte uint8_t
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+// Same as the Arduino build of the ATmega328P
+#ifndef MAX_RECORDINGS
+#define MAX_RECORDINGS 400
+#endif
+
+// Benchmark state, defined in bench.cpp
+extern void (*avr_interruptCallback)(void);
+extern uint32_t avr_now;
+extern uint16_t avr_rxPulses;
+
+static inline void hw_attachInterrupt(int, void (*callback)(void)) {
+  avr_interruptCallback = callback;
+}
+
+static inline void hw_detachInterrupt(int) {
+  avr_interruptCallback = 0;
+}
+
+static inline uint32_t hw_micros() {
+  return avr_now;
+}
+
+static inline void hw_delayMicroseconds(uint32_t time_to_wait) {
+  avr_now += time_to_wait;
+}
+
+static inline void hw_pinMode(int, int) {
+}
+
+static inline void hw_digitalWrite(int, int) {
+}
+
+// Level after the last received pulse, the first pulse is high
+static inline int hw_digitalRead(int) {
+  return (avr_rxPulses & 1) == 0;
+}
+
+static inline void hw_readProgmem(void *dst, const void *src, size_t size) {
+  memcpy_P(dst, src, size);
+}
+
+static inline uint8_t hw_readProgmemByte(const void *src) {
+  return pgm_read_byte(src);
+}
+
+static inline uint16_t hw_readProgmemWord(const void *src) {
+  return pgm_read_word(src);
+}
+
+static inline uint32_t hw_random(uint32_t max) {
+  return max ? random() % max : 0;
+}
+
+static inline void hw_noInterrupts() {
+}
+
+static inline void hw_interrupts() {
+}
+
+#define HW_HAS_TIMER 0
+#define HW_TICKS_PER_US 1
+
+static inline void *hw_pinPort(int) {
+  return 0;
+}
+
+static inline uint32_t hw_pinMask(int pin) {
+  return pin;
+}
+
+static inline void hw_portWrite(void *, uint32_t, int) {
+}
+
+#endif
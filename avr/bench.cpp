@@ -0,0 +1,226 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "avr_hal.h"
+#include "../RFControl.h"
+
+#if defined(BENCH_PULSES_HEADER)
+#include BENCH_PULSES_HEADER
+#endif
+
+/* Cycle benchmark of the receiver on an ATmega328P, run under simavr
+   or on a bare board with the serial port attached, see build.sh.
+   Timer1 counts CPU cycles, see cycles(). Each edge is fed to the isr
+   with the virtual clock of its pulse and the cycles of the call are
+   counted, as are the cycles of compressTimings() for every received
+   message.
+   The interrupt entry and exit of the Arduino core, about 80 cycles,
+   are not included. Results are printed on USART0 at 38400 baud as one
+   JSON object per line.
+
+   The input is a capture file embedded by embed.cpp, or a synthetic
+   signal of PT2262 style frames when built without one.
+ */
+
+#define BENCH_BAUD 38400
+
+void (*avr_interruptCallback)(void);
+uint32_t avr_now;
+uint16_t avr_rxPulses;
+
+struct CycleStats
+{
+  uint32_t min;
+  uint32_t max;
+  uint32_t sum;
+  uint32_t count;
+};
+
+void resetStats(CycleStats *stats) {
+  stats->min = 0xffffffffUL;
+  stats->max = 0;
+  stats->sum = 0;
+  stats->count = 0;
+}
+
+void addCycles(CycleStats *stats, uint32_t cycles) {
+  if (cycles < stats->min) {
+    stats->min = cycles;
+  }
+  if (cycles > stats->max) {
+    stats->max = cycles;
+  }
+  stats->sum += cycles;
+  stats->count++;
+}
+
+/* Cycles since the start. Timer1 counts the low 16 bits at the CPU
+   clock and its overflow interrupt the high ones, so calls longer than
+   65535 cycles, e.g. compressTimings() of a long message, are not
+   wrapped. An overflow interrupt adds about 30 cycles to the sample it
+   falls in.
+ */
+volatile uint16_t cyclesHigh;
+
+ISR(TIMER1_OVF_vect) {
+  cyclesHigh++;
+}
+
+uint32_t cycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t low = TCNT1;
+  uint16_t high = cyclesHigh;
+  // Overflowed after interrupts were disabled and not counted yet
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000) {
+    high++;
+  }
+  SREG = sreg;
+  return ((uint32_t)high << 16) | low;
+}
+
+void uartInit() {
+  UBRR0 = F_CPU / 16 / BENCH_BAUD - 1;
+  UCSR0B = _BV(TXEN0);
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+}
+
+void uartPut(char c) {
+  loop_until_bit_is_set(UCSR0A, UDRE0);
+  UDR0 = c;
+}
+
+void printString(const char *s) {
+  while (*s) {
+    uartPut(*s++);
+  }
+}
+
+void printNumber(uint32_t n) {
+  char digits[10];
+  uint8_t i = 0;
+  do {
+    digits[i++] = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  while (i) {
+    uartPut(digits[--i]);
+  }
+}
+
+void report(const char *benchmark, const char *input, const char *unit, const CycleStats *stats) {
+  printString("{\"benchmark\": \"");
+  printString(benchmark);
+  printString("\", \"input\": \"");
+  printString(input);
+  printString("\", \"unit\": \"");
+  printString(unit);
+  printString("\", \"min\": ");
+  printNumber(stats->count ? stats->min : 0);
+  // Average with one decimal
+  uint32_t avg = stats->count ? (stats->sum * 10 + stats->count / 2) / stats->count : 0;
+  printString(", \"avg\": ");
+  printNumber(avg / 10);
+  uartPut('.');
+  printNumber(avg % 10);
+  printString(", \"max\": ");
+  printNumber(stats->max);
+  printString(", \"count\": ");
+  printNumber(stats->count);
+  printString(", \"f_cpu\": ");
+  printNumber(F_CPU);
+  printString("}\n");
+}
+
+#if defined(BENCH_PULSES_HEADER)
+uint32_t pulsesSize() {
+  return BENCH_PULSES_SIZE;
+}
+
+uint16_t pulse(uint32_t i) {
+  return pgm_read_word(&bench_pulses[i]);
+}
+#else
+#define BENCH_INPUT "synthetic"
+
+// 100 frames of 24 bits with 4 repeats, two pulses per bit plus sync
+#define SYNTH_FRAMES 100
+#define SYNTH_FRAME_PULSES (24 * 2 + 2)
+
+uint32_t synthSeed;
+uint32_t synthCode;
+
+uint32_t pulsesSize() {
+  return (uint32_t)SYNTH_FRAMES * 4 * SYNTH_FRAME_PULSES;
+}
+
+// Only called with consecutive i
+uint16_t pulse(uint32_t i) {
+  uint16_t p = i % SYNTH_FRAME_PULSES;
+  if (i % (4 * SYNTH_FRAME_PULSES) == 0) {
+    synthCode = synthSeed = synthSeed * 1103515245 + 12345;
+  }
+  if (p >= 48) {
+    return p == 48 ? 400 : 12400;
+  }
+  bool one = (synthCode >> (p / 2)) & 1;
+  bool first = (p & 1) == 0;
+  if (first) {
+    synthSeed = synthSeed * 1103515245 + 12345;
+  }
+  int jitter = (int)((synthSeed >> 16) % 61) - 30;
+  if (first) {
+    return (one ? 1200 : 400) + jitter;
+  }
+  return (one ? 400 : 1200) - jitter;
+}
+#endif
+
+int main() {
+  uartInit();
+  // Timer1 free running at the CPU clock
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TIMSK1 = _BV(TOIE1);
+  sei();
+
+  // Cost of reading the counter twice
+  uint32_t start = cycles();
+  uint32_t overhead = cycles() - start;
+
+  CycleStats edges;
+  CycleStats compress;
+  resetStats(&edges);
+  resetStats(&compress);
+
+  RFControl::startReceiving(0);
+  uint32_t size = pulsesSize();
+  for (uint32_t i = 0; i < size; i++) {
+    avr_now += pulse(i);
+    avr_rxPulses++;
+    start = cycles();
+    avr_interruptCallback();
+    addCycles(&edges, cycles() - start - overhead);
+
+    if (RFControl::hasData()) {
+      unsigned int *timings;
+      unsigned int timings_size;
+      unsigned int buckets[8];
+      RFControl::getRaw(&timings, &timings_size);
+      start = cycles();
+      RFControl::compressTimings(buckets, timings, timings_size);
+      addCycles(&compress, cycles() - start - overhead);
+      RFControl::continueReceiving();
+    }
+  }
+
+  report("isr", BENCH_INPUT, "cycles/edge", &edges);
+  report("compressTimings", BENCH_INPUT, "cycles/call", &compress);
+
+  // simavr exits when the CPU sleeps with interrupts disabled
+  cli();
+  sleep_mode();
+  for (;;) {
+  }
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Cross-compiles the cycle benchmark for an ATmega328P and runs it under
+# simavr when run_avr is installed, printing the JSON result lines.
+#
+#   ./build.sh                synthetic signal
+#   ./build.sh file [pulses]  capture file, see ../simulate/capture.h
+set -e
+MCU=atmega328p
+F_CPU=16000000
+HAL='-DRF_CONTROL_HAL="avr_hal.h" -I.'
+FLAGS="-Wall -Os -mmcu=$MCU -DF_CPU=${F_CPU}UL -fno-exceptions -fno-threadsafe-statics"
+PULSES=
+if [ -n "$1" ]; then
+  g++ -Wall -O2 embed.cpp ../simulate/capture.cpp -o embed
+  ./embed "$1" $2 > pulses.h
+  PULSES='-DBENCH_PULSES_HEADER="pulses.h"'
+fi
+avr-g++ $FLAGS $HAL -c ../RFControl.cpp -o RFControl.o
+avr-g++ $FLAGS $HAL $PULSES bench.cpp RFControl.o -o bench.elf
+avr-size bench.elf
+if command -v run_avr > /dev/null; then
+  # simavr prints the serial output with its own prefix and colours
+  run_avr -m $MCU -f $F_CPU bench.elf 2>&1 | sed -n 's/^[^{]*\({.*}\).*$/\1/p'
+fi
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../simulate/capture.h"
+
+/* Converts a capture file, see ../simulate/capture.h, to a header with
+   the pulses in flash for the AVR benchmark.
+
+     embed file [max_pulses] > pulses.h
+
+   Pulses are clamped to 16 bit, longer ones are sync gaps to the
+   decoder anyway. The ATmega328P has room for about 8000 pulses next
+   to the library.
+ */
+
+unsigned long limit = 6000;
+unsigned long count;
+
+void emit(unsigned int pulse) {
+  if (count == limit) {
+    return;
+  }
+  const char *separator = count == 0 ? "  " : count % 12 ? ", " : ",\n  ";
+  printf("%s%u", separator, pulse > 65535 ? 65535 : pulse);
+  count++;
+}
+
+int main(int argc, const char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: embed file [max_pulses]\n");
+    return 1;
+  }
+  if (argc > 2) {
+    limit = strtoul(argv[2], 0, 0);
+  }
+  printf("// Generated by embed from %s\n", argv[1]);
+  printf("const uint16_t bench_pulses[] PROGMEM = {\n");
+  if (sim_readCapture(argv[1], emit) < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  if (count == 0) {
+    fprintf(stderr, "%s: no pulses\n", argv[1]);
+    return 1;
+  }
+  printf("\n};\n");
+  printf("#define BENCH_PULSES_SIZE %lu\n", count);
+  printf("#define BENCH_INPUT \"%s\"\n", argv[1]);
+  return 0;
+}
@@ -0,0 +1,17 @@
+#include <RFControl.h>
+
+// A stored command as printed by the packed example: buckets in pulse
+// length divider units and bucket indices packed three bits per pulse.
+const uint16_t buckets[8] PROGMEM = { 100, 300, 3100, 0, 0, 0, 0, 0 };
+const uint8_t command[] PROGMEM = {
+  0x08, 0x12, 0x20, 0x41, 0x10, 0x04, 0x08, 0x12, 0x20, 0x41, 0x80, 0x04,
+  0x01, 0x82, 0x04, 0x08, 0x82, 0x20, 0x10
+};
+const unsigned int command_size = 50;
+
+void setup() {
+  RFControl::sendByFlashTimings(4, buckets, command, command_size);
+}
+
+void loop() {
+}
@@ -0,0 +1,27 @@
+#include <RFControl.h>
+
+void setup() {
+  Serial.begin(9600);
+  RFControl::startReceiving(0);
+}
+
+void loop() {
+  if(RFControl::hasData()) {
+    unsigned int *timings;
+    unsigned int timings_size;
+    RFControl::getRaw(&timings, &timings_size);
+    RFPackedTimings message;
+    if(RFControl::compressTimingsPacked(&message, timings, timings_size)) {
+      // Binary frame: size, eight buckets (in pulse length divider units)
+      // and the packed bucket indices, all little endian
+      Serial.write(message.size & 0xff);
+      Serial.write(message.size >> 8);
+      for(int i=0; i < 8; i++) {
+        Serial.write(message.buckets[i] & 0xff);
+        Serial.write(message.buckets[i] >> 8);
+      }
+      Serial.write(message.data, RFControl::getPackedSize(message.size));
+    }
+    RFControl::continueReceiving();
+  }
+}
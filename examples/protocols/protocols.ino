@@ -0,0 +1,37 @@
+#include <RFControl.h>
+
+// Protocol table in flash. Ratios are relative to the shortest bucket
+// in quarters, shortest first, the decoder maps index pairs of the
+// buckets in that order to bits.
+const RFProtocol protocols[] PROGMEM = {
+  // PT2262 style: 24 bits of 1:3 pulses followed by a sync of 31 periods
+  { 1, 50, { 4, 12, 124, 0, 0, 0, 0, 0 }, { RF_PAIR(0, 1), RF_PAIR(1, 0), 0, 2, RF_MSB_FIRST } }
+};
+
+void setup() {
+  Serial.begin(9600);
+  RFControl::startReceiving(0);
+}
+
+void loop() {
+  if(RFControl::hasData()) {
+    unsigned int *timings;
+    unsigned int timings_size;
+    RFControl::getRaw(&timings, &timings_size);
+    unsigned int buckets[8];
+    if(RFControl::compressTimings(buckets, timings, timings_size)) {
+      uint64_t payload;
+      int protocol = RFControl::matchProtocol(protocols, sizeof(protocols) / sizeof(protocols[0]), buckets, timings, timings_size, &payload);
+      if(protocol >= 0) {
+        Serial.print("p: ");
+        Serial.print(protocol);
+        Serial.write(' ');
+        Serial.print((unsigned long)(payload >> 32), HEX);
+        Serial.write(' ');
+        Serial.print((unsigned long)payload, HEX);
+        Serial.write('\n');
+      }
+    }
+    RFControl::continueReceiving();
+  }
+}
@@ -0,0 +1,9 @@
+#!/bin/sh
+# Builds the library against the Linux platform functions and the
+# rfsniff receiver tool and rfd gateway daemon
+HAL='-DRF_CONTROL_HAL="linux_hal.h" -I.'
+g++ -Wall -O2 $HAL -c ../RFControl.cpp -o RFControl.o
+g++ -Wall -O2 $HAL -c rf_linux.cpp -o rf_linux.o
+g++ -Wall -O2 $HAL -c ook_demod.cpp -o ook_demod.o
+g++ -Wall -O2 $HAL rfsniff.cpp rf_linux.o ook_demod.o RFControl.o -o rfsniff
+g++ -Wall -O2 $HAL rfd.cpp rf_linux.o RFControl.o -o rfd
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Builds the tools and decodes the recordings in captures/ with rfsniff,
+# the payloads have to match the .expected file of each recording.
+# pt2262.events holds three transmissions of four frames from the
+# simulator's generate -n 3 -J 30 -s 3, as GPIO line events.
+# pt2262-sdr.cu8 is the transmission of generate -n 1 -r 3 -J 30 -s 5
+# as rtl_sdr I/Q samples at 250 kS/s, with a 20 kHz carrier offset and
+# noise. pt2262-burst.cu8 is generate -n 2 -r 5 -t 250 -J 20 -s 7 the
+# same way, ten frames in 0.4 s, so one read of rfsniff holds more
+# messages than the receiver buffers.
+cd "$(dirname "$0")"
+sh build.sh || exit 1
+failed=0
+
+# check expected rfsniff-arguments...
+check() {
+  expected=$1
+  shift
+  if ./rfsniff "$@" | grep '^p:' | diff -u "$expected" -; then
+    echo "$expected: ok"
+  else
+    echo "$expected: failed"
+    failed=1
+  fi
+}
+
+check captures/pt2262.expected -r captures/pt2262.events
+check captures/pt2262-sdr.expected -q captures/pt2262-sdr.cu8 250000
+# Streamed from stdin
+check captures/pt2262-sdr.expected -q - 250000 < captures/pt2262-sdr.cu8
+check captures/pt2262-burst.expected -q captures/pt2262-burst.cu8 250000
+exit $failed
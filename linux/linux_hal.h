@@ -0,0 +1,124 @@
+#ifndef LINUX_HAL_H
+#define LINUX_HAL_H
+
+/* Platform functions for Linux gateways. RFControl.cpp includes this in
+   place of arduino_functions.h when built with
+   -DRF_CONTROL_HAL='"linux_hal.h"'. Edges come from the GPIO character
+   device, see rf_linux.h, and are fed to the receiver isr one by one.
+   While an edge is being fed, hw_micros() and hw_digitalRead() return
+   its kernel timestamp and level, so the decoder sees the time the
+   edge happened instead of the time it was read. RFControl and
+   rf_linux_pump() have to be called from the same thread.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define byte uint8_t
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#ifndef MAX_RECORDINGS
+#define MAX_RECORDINGS 512
+#endif
+
+// The edge being fed to the isr, defined in rf_linux.cpp
+extern bool linux_inEvent;
+extern unsigned long linux_eventTime;
+extern int linux_eventLevel;
+extern void (*linux_interruptCallback)(void);
+
+// Sets the transmitter line, does nothing if none is open
+void linux_writeLine(int value);
+
+static inline unsigned long linux_clockMicros() {
+  struct timespec ts;
+  // Same clock as the kernel edge timestamps
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+static inline void hw_attachInterrupt(int, void (*callback)(void)) {
+  linux_interruptCallback = callback;
+}
+
+static inline void hw_detachInterrupt(int) {
+  linux_interruptCallback = 0;
+}
+
+static inline unsigned long hw_micros() {
+  return linux_inEvent ? linux_eventTime : linux_clockMicros();
+}
+
+static inline void hw_delayMicroseconds(uint32_t time_to_wait) {
+  unsigned long start = linux_clockMicros();
+  if (time_to_wait > 1000) {
+    // Sleep through most of it, the scheduler may wake us late
+    struct timespec ts = { (time_t)((time_to_wait - 500) / 1000000), (long)((time_to_wait - 500) % 1000000) * 1000 };
+    nanosleep(&ts, 0);
+  }
+  while (linux_clockMicros() - start < time_to_wait) {
+  }
+}
+
+static inline void hw_pinMode(int, int) {
+}
+
+static inline void hw_digitalWrite(int, int value) {
+  linux_writeLine(value);
+}
+
+static inline int hw_digitalRead(int) {
+  return linux_eventLevel;
+}
+
+static inline void hw_readProgmem(void *dst, const void *src, size_t size) {
+  memcpy(dst, src, size);
+}
+
+static inline uint8_t hw_readProgmemByte(const void *src) {
+  return *(const uint8_t*)src;
+}
+
+static inline uint16_t hw_readProgmemWord(const void *src) {
+  return *(const uint16_t*)src;
+}
+
+static inline uint32_t hw_random(uint32_t max) {
+  return max ? rand() % max : 0;
+}
+
+// Edges are fed from the calling thread, nothing to lock out
+static inline void hw_noInterrupts() {
+}
+
+static inline void hw_interrupts() {
+}
+
+// No transmitter timer, asynchronous sends go out blocking
+#define HW_HAS_TIMER 0
+#define HW_TICKS_PER_US 1
+
+static inline void *hw_pinPort(int) {
+  return 0;
+}
+
+static inline uint32_t hw_pinMask(int pin) {
+  return pin;
+}
+
+static inline void hw_portWrite(void *, uint32_t, int value) {
+  linux_writeLine(value);
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "ook_demod.h"
+#include "linux_hal.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Magnitudes computed per block
+#define OOK_BLOCK 1024
+
+// The peak decays to the floor with a time constant of 2^16 samples,
+// longer than the sync gaps between repeats
+#define OOK_PEAK_DECAY 16
+
+// The floor follows the noise with a time constant of 2^8 samples
+#define OOK_FLOOR_SHIFT 8
+
+// A signal has to be this much above the floor, the peak at least
+// 4 times the floor
+#define OOK_MIN_LEVEL 64
+
+void rf_ook_init(RFOokDemod *demod, uint32_t sampleRate) {
+  memset(demod, 0, sizeof(*demod));
+  demod->sampleRate = sampleRate;
+  demod->level = LOW;
+}
+
+void rf_ook_magnitude(const uint8_t *iq, uint16_t *magnitude, size_t count) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  // 8 samples per step: widen to 16 bit, remove the 128 offset and let
+  // madd add I*I and Q*Q of each sample
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i offset = _mm_set1_epi16(128);
+  for (; i + 8 <= count; i += 8) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(iq + 2 * i));
+    __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(bytes, zero), offset);
+    __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(bytes, zero), offset);
+    __m128i magLo = _mm_madd_epi16(lo, lo);
+    __m128i magHi = _mm_madd_epi16(hi, hi);
+    // At most 2 * 128^2, saturates at 32767
+    _mm_storeu_si128((__m128i*)(magnitude + i), _mm_packs_epi32(magLo, magHi));
+  }
+#elif defined(__ARM_NEON)
+  const int16x8_t offset = vdupq_n_s16(128);
+  for (; i + 8 <= count; i += 8) {
+    uint8x8x2_t samples = vld2_u8(iq + 2 * i);
+    int16x8_t re = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(samples.val[0])), offset);
+    int16x8_t im = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(samples.val[1])), offset);
+    int32x4_t magLo = vmlal_s16(vmull_s16(vget_low_s16(re), vget_low_s16(re)), vget_low_s16(im), vget_low_s16(im));
+    int32x4_t magHi = vmlal_s16(vmull_s16(vget_high_s16(re), vget_high_s16(re)), vget_high_s16(im), vget_high_s16(im));
+    vst1q_u16(magnitude + i, vreinterpretq_u16_s16(vcombine_s16(vqmovn_s32(magLo), vqmovn_s32(magHi))));
+  }
+#endif
+  for (; i < count; i++) {
+    int re = iq[2 * i] - 128;
+    int im = iq[2 * i + 1] - 128;
+    int mag = re * re + im * im;
+    magnitude[i] = mag > 32767 ? 32767 : mag;
+  }
+}
+
+void rf_ook_flush(RFOokDemod *demod) {
+  rf_linux_dispatch(demod->edges, demod->edgesSize);
+  demod->edgesSize = 0;
+}
+
+void addEdge(RFOokDemod *demod) {
+  // Sample time in ns without overflowing on long recordings
+  uint64_t seconds = demod->sample / demod->sampleRate;
+  uint64_t rest = demod->sample % demod->sampleRate;
+  struct gpio_v2_line_event *edge = &demod->edges[demod->edgesSize++];
+  memset(edge, 0, sizeof(*edge));
+  edge->timestamp_ns = seconds * 1000000000ULL + rest * 1000000000ULL / demod->sampleRate;
+  edge->id = demod->level ? GPIO_V2_LINE_EVENT_RISING_EDGE : GPIO_V2_LINE_EVENT_FALLING_EDGE;
+  if (demod->edgesSize == RF_LINUX_BATCH) {
+    rf_ook_flush(demod);
+  }
+}
+
+void sliceSample(RFOokDemod *demod, uint16_t magnitude) {
+  byte pos = demod->sample & (OOK_WINDOW - 1);
+  demod->windowSum += magnitude - demod->window[pos];
+  demod->window[pos] = magnitude;
+  uint32_t m = demod->windowSum / OOK_WINDOW;
+
+  // The peak follows the signal up at once and decays slowly, the
+  // floor follows the noise while the line is low. Both are kept with
+  // 16 fraction bits.
+  uint32_t level16 = m << 16;
+  if (level16 > demod->peak) {
+    demod->peak = level16;
+  }
+  else {
+    demod->peak -= (demod->peak - demod->floor) >> OOK_PEAK_DECAY;
+  }
+  if (!demod->level) {
+    demod->floor = (int64_t)demod->floor + (((int64_t)level16 - demod->floor) >> OOK_FLOOR_SHIFT);
+  }
+  if (demod->peak < demod->floor) {
+    demod->peak = demod->floor;
+  }
+
+  uint32_t floor = demod->floor >> 16;
+  uint32_t range = (demod->peak >> 16) - floor;
+  bool signal = range > 3 * floor + OOK_MIN_LEVEL;
+  int level = demod->level;
+  // Hysteresis around the midpoint
+  if (level && (!signal || m < floor + range * 3 / 8)) {
+    level = LOW;
+  }
+  else if (!level && signal && m > floor + range * 5 / 8) {
+    level = HIGH;
+  }
+  if (level != demod->level) {
+    demod->level = level;
+    addEdge(demod);
+  }
+  demod->sample++;
+}
+
+void rf_ook_process(RFOokDemod *demod, const uint8_t *iq, size_t count) {
+  uint16_t magnitude[OOK_BLOCK];
+  while (count > 0) {
+    size_t block = count < OOK_BLOCK ? count : OOK_BLOCK;
+    rf_ook_magnitude(iq, magnitude, block);
+    for (size_t i = 0; i < block; i++) {
+      sliceSample(demod, magnitude[i]);
+    }
+    iq += 2 * block;
+    count -= block;
+  }
+}
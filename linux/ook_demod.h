@@ -0,0 +1,48 @@
+#ifndef OOK_DEMOD_H
+#define OOK_DEMOD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "rf_linux.h"
+
+/* On-off keying demodulator for raw SDR recordings, 8 bit unsigned I/Q
+   samples as written by rtl_sdr. The squared magnitude of each sample
+   is smoothed and sliced against a threshold halfway between the noise
+   floor and the signal peak, which both adapt to the recording. Each
+   level change becomes an edge event for the receiver isr, timed by
+   sample count, so a recording decodes the same as the live line.
+   Samples can be passed in pieces of any size, so files of any length
+   are streamed.
+ */
+
+// Samples in the smoothing window, a power of two
+#define OOK_WINDOW 8
+
+struct RFOokDemod
+{
+  uint32_t sampleRate;
+  // Samples processed so far
+  uint64_t sample;
+  // Smoothing window of magnitudes
+  uint16_t window[OOK_WINDOW];
+  uint32_t windowSum;
+  // Levels of the noise and of the strongest recent signal, 16.16
+  uint32_t floor;
+  uint32_t peak;
+  int level;
+  struct gpio_v2_line_event edges[RF_LINUX_BATCH];
+  unsigned int edgesSize;
+};
+
+void rf_ook_init(RFOokDemod *demod, uint32_t sampleRate);
+
+// Squared magnitudes of count samples, iq holds 2 * count bytes
+void rf_ook_magnitude(const uint8_t *iq, uint16_t *magnitude, size_t count);
+
+// Demodulates count samples and feeds the edges to the receiver
+void rf_ook_process(RFOokDemod *demod, const uint8_t *iq, size_t count);
+
+// Feeds edges still held back for a batch
+void rf_ook_flush(RFOokDemod *demod);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef PROTOCOLS_H
+#define PROTOCOLS_H
+
+#include "../RFControl.h"
+
+// Protocols decoded by rfsniff and rfd, PT2262 style as in the
+// protocols example
+static const RFProtocol protocols[] = {
+  { 1, 50, { 4, 12, 124, 0, 0, 0, 0, 0 }, { RF_PAIR(0, 1), RF_PAIR(1, 0), 0, 2, RF_MSB_FIRST } }
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "rf_linux.h"
+#include "linux_hal.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+bool linux_inEvent = false;
+unsigned long linux_eventTime;
+int linux_eventLevel = LOW;
+void (*linux_interruptCallback)(void) = 0;
+
+// Line request of the transmitter
+int outputFd = -1;
+
+// Copy of the events for rf_linux_record()
+int recordFd = -1;
+
+// Set by rf_linux_afterEvent()
+void (*afterEvent)(void) = 0;
+
+int requestLine(const char *chip, unsigned int line, uint64_t flags) {
+  int chipFd = open(chip, O_RDONLY | O_CLOEXEC);
+  if (chipFd < 0) {
+    return -1;
+  }
+  struct gpio_v2_line_request request;
+  memset(&request, 0, sizeof(request));
+  request.offsets[0] = line;
+  request.num_lines = 1;
+  request.config.flags = flags;
+  strncpy(request.consumer, "rfcontrol", sizeof(request.consumer) - 1);
+  int result = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request);
+  close(chipFd);
+  return result < 0 ? -1 : request.fd;
+}
+
+int rf_linux_openInput(const char *chip, unsigned int line) {
+  return requestLine(chip, line, GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING);
+}
+
+int rf_linux_openOutput(const char *chip, unsigned int line) {
+  outputFd = requestLine(chip, line, GPIO_V2_LINE_FLAG_OUTPUT);
+  return outputFd < 0 ? -1 : 0;
+}
+
+int rf_linux_openReplay(const char *path) {
+  return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+void rf_linux_record(int fd) {
+  recordFd = fd;
+}
+
+void rf_linux_afterEvent(void (*callback)(void)) {
+  afterEvent = callback;
+}
+
+void linux_writeLine(int value) {
+  if (outputFd < 0) {
+    return;
+  }
+  struct gpio_v2_line_values values;
+  values.bits = value ? 1 : 0;
+  values.mask = 1;
+  ioctl(outputFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+}
+
+void rf_linux_dispatch(const struct gpio_v2_line_event *events, unsigned int count) {
+  linux_inEvent = true;
+  for (unsigned int i = 0; i < count; i++) {
+    linux_eventTime = events[i].timestamp_ns / 1000;
+    linux_eventLevel = events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE ? HIGH : LOW;
+    if (linux_interruptCallback) {
+      linux_interruptCallback();
+    }
+    if (afterEvent) {
+      afterEvent();
+    }
+  }
+  linux_inEvent = false;
+}
+
+int rf_linux_pump(int fd) {
+  struct gpio_v2_line_event events[RF_LINUX_BATCH];
+  ssize_t size = read(fd, events, sizeof(events));
+  if (size < 0) {
+    return -1;
+  }
+  // A replay file may end in a partial record
+  unsigned int count = size / sizeof(events[0]);
+  if (recordFd >= 0 && count > 0) {
+    if (write(recordFd, events, count * sizeof(events[0])) < 0) {
+      recordFd = -1;
+    }
+  }
+  rf_linux_dispatch(events, count);
+  return count;
+}
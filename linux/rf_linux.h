@@ -0,0 +1,46 @@
+#ifndef RF_LINUX_H
+#define RF_LINUX_H
+
+#include <linux/gpio.h>
+
+/* Linux backend for RFControl. The receiver line is requested from the
+   GPIO character device (ABI v2) with edge detection on both edges.
+   The kernel queues the edges with timestamps, and rf_linux_pump()
+   reads them in batches and feeds them to the receiver isr. A replay
+   file holds the same struct gpio_v2_line_event records, so recorded
+   captures go through exactly the same path.
+ */
+
+// Events read per call of rf_linux_pump()
+#define RF_LINUX_BATCH 64
+
+// Requests line of chip (e.g. "/dev/gpiochip0") for receiving, returns
+// the event fd or -1
+int rf_linux_openInput(const char *chip, unsigned int line);
+
+// Requests line of chip for the transmitter, returns 0 or -1
+int rf_linux_openOutput(const char *chip, unsigned int line);
+
+// Opens a file of recorded events for replay, returns the fd or -1
+int rf_linux_openReplay(const char *path);
+
+// Writes every event read by rf_linux_pump() to fd as well, -1 stops
+void rf_linux_record(int fd);
+
+/* Calls callback after each event fed to the receiver, while
+   linux_eventTime still holds the time of that event. Messages taken
+   there get the time of the edge that completed them rather than of
+   the last edge of the batch. 0 removes the callback.
+ */
+void rf_linux_afterEvent(void (*callback)(void));
+
+/* Reads the next batch of events from fd and feeds them to the receiver.
+   Blocks until edges arrive on a line fd. Returns the number of events
+   fed, 0 at the end of a replay file and -1 on errors.
+ */
+int rf_linux_pump(int fd);
+
+// Feeds count events to the receiver isr
+void rf_linux_dispatch(const struct gpio_v2_line_event *events, unsigned int count);
+
+#endif
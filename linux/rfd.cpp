@@ -0,0 +1,472 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "linux_hal.h"
+#include "rf_linux.h"
+#include "rfd.h"
+#include "protocols.h"
+#include "../RFControl.h"
+
+/* Gateway daemon. Captured messages are compressed, optionally matched
+   against the protocol table, and sent to every subscriber of a UNIX
+   domain socket as JSON lines or binary records, see rfd.h.
+
+     rfd [-p] [-w count] socket receiver...
+
+     receiver    chip:line for a GPIO line, e.g. /dev/gpiochip0:17,
+                 otherwise a replay file of recorded events
+     -p          decode the protocols in protocols.h
+     -w count    start receiving when count subscribers are connected
+
+   The library keeps its receiver state in globals, so every receiver
+   runs in a worker process of its own and sends its records to the
+   daemon over a pipe. Each subscriber has a bounded queue. Messages
+   that do not fit are dropped for that subscriber only and counted in
+   the records it gets later. With only replay files the daemon exits
+   once they are done and the queues are empty.
+ */
+
+#define RFD_MAX_RECEIVERS 8
+#define RFD_MAX_CLIENTS 32
+
+// Queued bytes per subscriber
+#define RFD_QUEUE_SIZE 65536
+
+bool decodeProtocols = false;
+
+struct Receiver {
+  pid_t pid;
+  int fd;
+  // Bytes of a record read only partly from the pipe
+  uint8_t pending[RFD_MAX_RECORD];
+  size_t pending_size;
+};
+
+struct Client {
+  int fd;
+  bool binary;
+  uint8_t queue[RFD_QUEUE_SIZE];
+  size_t head;
+  size_t size;
+  unsigned long sent;
+  uint32_t dropped;
+  char line[16];
+  size_t line_size;
+};
+
+Receiver receivers[RFD_MAX_RECEIVERS];
+int receivers_size;
+Client *clients[RFD_MAX_CLIENTS];
+
+volatile sig_atomic_t stopping = 0;
+
+void stop(int) {
+  stopping = 1;
+}
+
+// Sends the record of the current message, completed at time, to the daemon
+void sendRecord(int receiver, int out, unsigned long time) {
+  uint8_t buffer[RFD_MAX_RECORD];
+  RfdRecord *record = (RfdRecord*)buffer;
+  unsigned int *timings;
+  unsigned int timings_size;
+  unsigned int buckets[8];
+  RFControl::getRaw(&timings, &timings_size);
+  if (!RFControl::compressTimings(buckets, timings, timings_size)) {
+    // More than 8 pulse lengths, noise rather than a message
+    return;
+  }
+  uint64_t payload = 0;
+  int protocol = -1;
+  if (decodeProtocols) {
+    protocol = RFControl::matchProtocol(protocols, sizeof(protocols) / sizeof(protocols[0]), buckets, timings, timings_size, &payload);
+  }
+  record->receiver = receiver;
+  record->protocol = protocol;
+  record->dropped = 0;
+  record->time = time;
+  record->payload = protocol >= 0 ? payload : 0;
+  for (int i = 0; i < 8; i++) {
+    record->buckets[i] = buckets[i] * RFControl::getPulseLengthDivider();
+  }
+  record->size = timings_size;
+  RFControl::packTimings(timings, timings_size, buffer + sizeof(RfdRecord));
+  record->length = sizeof(RfdRecord) + RFControl::getPackedSize(timings_size);
+  // Records are shorter than PIPE_BUF, so the write is atomic
+  if (write(out, buffer, record->length) < 0) {
+    exit(1);
+  }
+}
+
+// Receiver and pipe of the worker process
+int workerReceiver;
+int workerOut;
+
+// Takes the messages completed by the edge just fed to the receiver
+void takeMessages() {
+  while (RFControl::hasData()) {
+    sendRecord(workerReceiver, workerOut, linux_eventTime);
+    RFControl::continueReceiving();
+  }
+}
+
+void runReceiver(int receiver, const char *spec, int out) {
+  const char *colon = strrchr(spec, ':');
+  int fd;
+  if (colon && strncmp(spec, "/dev/", 5) == 0) {
+    char chip[256];
+    snprintf(chip, sizeof(chip), "%.*s", (int)(colon - spec), spec);
+    fd = rf_linux_openInput(chip, atoi(colon + 1));
+  }
+  else {
+    fd = rf_linux_openReplay(spec);
+  }
+  if (fd < 0) {
+    perror(spec);
+    exit(1);
+  }
+  workerReceiver = receiver;
+  workerOut = out;
+  rf_linux_afterEvent(takeMessages);
+  RFControl::startReceiving(0);
+  int count;
+  while ((count = rf_linux_pump(fd)) > 0) {
+    // Messages are sent by takeMessages() as their last edge arrives
+  }
+  if (count < 0) {
+    perror(spec);
+    exit(1);
+  }
+  exit(0);
+}
+
+// Appends a message to the queue of the client, or drops it whole
+void enqueue(Client *client, const void *data, size_t size) {
+  if (client->size + size > RFD_QUEUE_SIZE) {
+    client->dropped++;
+    return;
+  }
+  size_t tail = (client->head + client->size) % RFD_QUEUE_SIZE;
+  size_t first = size < RFD_QUEUE_SIZE - tail ? size : RFD_QUEUE_SIZE - tail;
+  memcpy(client->queue + tail, data, first);
+  memcpy(client->queue, (const uint8_t*)data + first, size - first);
+  client->size += size;
+  client->sent++;
+}
+
+// JSON line of a record after the leading {"dropped":n,
+size_t formatJson(const RfdRecord *record, char *json, size_t json_size) {
+  const uint8_t *packed = (const uint8_t*)(record + 1);
+  size_t n = snprintf(json, json_size, "\"receiver\":%u,\"time\":%llu,\"buckets\":[",
+    record->receiver, (unsigned long long)record->time);
+  for (int i = 0; i < 8; i++) {
+    n += snprintf(json + n, json_size - n, i ? ",%u" : "%u", record->buckets[i]);
+  }
+  n += snprintf(json + n, json_size - n, "],\"timings\":\"");
+  for (unsigned int i = 0; i < record->size && n + 1 < json_size; i++) {
+    json[n++] = '0' + RFControl::getPackedIndex(packed, i);
+  }
+  n += snprintf(json + n, json_size - n, "\"");
+  if (record->protocol >= 0) {
+    n += snprintf(json + n, json_size - n, ",\"protocol\":%d,\"payload\":\"%llx\"",
+      record->protocol, (unsigned long long)record->payload);
+  }
+  n += snprintf(json + n, json_size - n, "}\n");
+  return n;
+}
+
+void publish(const RfdRecord *record) {
+  char json[RFD_MAX_RECORD * 2 + 256];
+  size_t json_size = 0;
+  for (int i = 0; i < RFD_MAX_CLIENTS; i++) {
+    Client *client = clients[i];
+    if (!client) {
+      continue;
+    }
+    if (client->binary) {
+      uint8_t buffer[RFD_MAX_RECORD];
+      memcpy(buffer, record, record->length);
+      ((RfdRecord*)buffer)->dropped = client->dropped;
+      enqueue(client, buffer, record->length);
+    }
+    else {
+      if (json_size == 0) {
+        json_size = formatJson(record, json, sizeof(json));
+      }
+      char line[sizeof(json) + 32];
+      size_t prefix = snprintf(line, sizeof(line), "{\"dropped\":%u,", client->dropped);
+      memcpy(line + prefix, json, json_size);
+      enqueue(client, line, prefix + json_size);
+    }
+  }
+}
+
+void closeClient(int i) {
+  Client *client = clients[i];
+  fprintf(stderr, "rfd: subscriber %d gone, %lu messages, %u dropped\n", i, client->sent, client->dropped);
+  close(client->fd);
+  free(client);
+  clients[i] = 0;
+}
+
+// Writes as much of the queue as the socket takes
+void flush(int i) {
+  Client *client = clients[i];
+  while (client->size > 0) {
+    size_t chunk = client->size < RFD_QUEUE_SIZE - client->head ? client->size : RFD_QUEUE_SIZE - client->head;
+    ssize_t written = send(client->fd, client->queue + client->head, chunk, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        closeClient(i);
+      }
+      return;
+    }
+    client->head = (client->head + written) % RFD_QUEUE_SIZE;
+    client->size -= written;
+  }
+}
+
+// Reads the subscriber's mode commands
+void readClient(int i) {
+  Client *client = clients[i];
+  char buffer[64];
+  ssize_t size = recv(client->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+  if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    closeClient(i);
+    return;
+  }
+  for (ssize_t j = 0; j < size; j++) {
+    if (buffer[j] != '\n') {
+      if (client->line_size < sizeof(client->line) - 1) {
+        client->line[client->line_size++] = buffer[j];
+      }
+      continue;
+    }
+    client->line[client->line_size] = 0;
+    if (strcmp(client->line, "binary") == 0) {
+      client->binary = true;
+    }
+    else if (strcmp(client->line, "json") == 0) {
+      client->binary = false;
+    }
+    client->line_size = 0;
+  }
+}
+
+void acceptClient(int listener) {
+  int fd = accept(listener, 0, 0);
+  if (fd < 0) {
+    return;
+  }
+  for (int i = 0; i < RFD_MAX_CLIENTS; i++) {
+    if (!clients[i]) {
+      clients[i] = (Client*)calloc(1, sizeof(Client));
+      clients[i]->fd = fd;
+      return;
+    }
+  }
+  close(fd);
+}
+
+// Publishes the complete records read from the receiver's pipe
+bool readReceiver(Receiver *receiver) {
+  uint8_t buffer[4096];
+  ssize_t size = read(receiver->fd, buffer, sizeof(buffer));
+  if (size <= 0) {
+    return size < 0 && errno == EINTR;
+  }
+  for (ssize_t i = 0; i < size; i++) {
+    receiver->pending[receiver->pending_size++] = buffer[i];
+    if (receiver->pending_size >= sizeof(uint16_t)) {
+      uint16_t length;
+      memcpy(&length, receiver->pending, sizeof(length));
+      if (receiver->pending_size == length) {
+        publish((const RfdRecord*)receiver->pending);
+        receiver->pending_size = 0;
+      }
+    }
+  }
+  return true;
+}
+
+int listenOn(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 8) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void startReceivers(const char **specs, int listener) {
+  for (int i = 0; i < receivers_size; i++) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+      perror("rfd");
+      exit(1);
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+      // The worker blocks in read() on its line, where the flag of stop()
+      // would never be seen, so SIGTERM from the daemon ends it right away
+      signal(SIGINT, SIG_DFL);
+      signal(SIGTERM, SIG_DFL);
+      close(listener);
+      close(pipefd[0]);
+      for (int j = 0; j < RFD_MAX_CLIENTS; j++) {
+        if (clients[j]) {
+          close(clients[j]->fd);
+        }
+      }
+      for (int j = 0; j < i; j++) {
+        close(receivers[j].fd);
+      }
+      runReceiver(i, specs[i], pipefd[1]);
+    }
+    close(pipefd[1]);
+    receivers[i].pid = pid;
+    receivers[i].fd = pipefd[0];
+  }
+}
+
+int main(int argc, const char *argv[]) {
+  int waitFor = 0;
+  int first = 1;
+  while (first < argc && argv[first][0] == '-') {
+    if (strcmp(argv[first], "-p") == 0) {
+      decodeProtocols = true;
+      first++;
+    }
+    else if (strcmp(argv[first], "-w") == 0 && first + 1 < argc) {
+      waitFor = atoi(argv[first + 1]);
+      first += 2;
+    }
+    else {
+      break;
+    }
+  }
+  receivers_size = argc - first - 1;
+  if (receivers_size < 1 || receivers_size > RFD_MAX_RECEIVERS) {
+    fprintf(stderr, "usage: %s [-p] [-w count] socket receiver...\n", argv[0]);
+    return 2;
+  }
+  const char *path = argv[first];
+  int listener = listenOn(path);
+  if (listener < 0) {
+    perror(path);
+    return 1;
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  bool started = false;
+  int running = 0;
+  struct pollfd fds[1 + RFD_MAX_RECEIVERS + RFD_MAX_CLIENTS];
+  int owners[1 + RFD_MAX_RECEIVERS + RFD_MAX_CLIENTS];
+  while (!stopping) {
+    int connected = 0;
+    bool queued = false;
+    for (int i = 0; i < RFD_MAX_CLIENTS; i++) {
+      if (clients[i]) {
+        connected++;
+        queued |= clients[i]->size > 0;
+      }
+    }
+    if (!started && connected >= waitFor) {
+      startReceivers(argv + first + 1, listener);
+      started = true;
+      running = receivers_size;
+    }
+    if (started && running == 0 && !queued) {
+      // Only replay files and they are done
+      break;
+    }
+
+    // Listener, then receivers as -1 - index, then clients by index
+    int nfds = 0;
+    fds[nfds].fd = listener;
+    fds[nfds].events = POLLIN;
+    owners[nfds++] = RFD_MAX_CLIENTS;
+    for (int i = 0; started && i < receivers_size; i++) {
+      if (receivers[i].fd >= 0) {
+        fds[nfds].fd = receivers[i].fd;
+        fds[nfds].events = POLLIN;
+        owners[nfds++] = -1 - i;
+      }
+    }
+    for (int i = 0; i < RFD_MAX_CLIENTS; i++) {
+      if (clients[i]) {
+        fds[nfds].fd = clients[i]->fd;
+        fds[nfds].events = POLLIN | (clients[i]->size > 0 ? POLLOUT : 0);
+        owners[nfds++] = i;
+      }
+    }
+    if (poll(fds, nfds, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("rfd");
+      break;
+    }
+    for (int n = 0; n < nfds; n++) {
+      if (!fds[n].revents) {
+        continue;
+      }
+      int owner = owners[n];
+      if (owner == RFD_MAX_CLIENTS) {
+        acceptClient(listener);
+      }
+      else if (owner < 0) {
+        Receiver *receiver = &receivers[-1 - owner];
+        if (!readReceiver(receiver)) {
+          close(receiver->fd);
+          receiver->fd = -1;
+          running--;
+        }
+      }
+      else if (clients[owner]) {
+        if (fds[n].revents & (POLLIN | POLLHUP | POLLERR)) {
+          readClient(owner);
+        }
+        if (clients[owner] && (fds[n].revents & POLLOUT)) {
+          flush(owner);
+        }
+      }
+    }
+  }
+
+  for (int i = 0; started && i < receivers_size; i++) {
+    kill(receivers[i].pid, SIGTERM);
+    waitpid(receivers[i].pid, 0, 0);
+  }
+  for (int i = 0; i < RFD_MAX_CLIENTS; i++) {
+    if (clients[i]) {
+      closeClient(i);
+    }
+  }
+  close(listener);
+  unlink(path);
+  return 0;
+}
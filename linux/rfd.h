@@ -0,0 +1,35 @@
+#ifndef RFD_H
+#define RFD_H
+
+#include <stdint.h>
+
+/* Binary records of the rfd gateway daemon, see rfd.cpp. Subscribers
+   get JSON lines unless they send "binary\n", after which every message
+   is one record in host byte order followed by the packed bucket
+   indices, three bits per pulse like RFControl::packTimings(). Sending
+   "json\n" switches back.
+ */
+
+struct RfdRecord
+{
+  // Bytes of the record including the indices
+  uint16_t length;
+  uint8_t receiver;
+  // Index in the protocol table, -1 if none matched or decoding is off
+  int8_t protocol;
+  // Messages this subscriber lost so far because it read too slowly
+  uint32_t dropped;
+  // Time of the edge that ended the message's sync in micros,
+  // CLOCK_MONOTONIC for GPIO lines
+  uint64_t time;
+  uint64_t payload;
+  // Bucket lengths in micros
+  uint32_t buckets[8];
+  // Pulses, followed by (size * 3 + 7) / 8 bytes of indices
+  uint16_t size;
+} __attribute__((packed));
+
+// Longest record, MAX_RECORDINGS pulses
+#define RFD_MAX_RECORD (sizeof(RfdRecord) + (512 * 3 + 7) / 8)
+
+#endif
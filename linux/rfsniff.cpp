@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "linux_hal.h"
+#include "rf_linux.h"
+#include "ook_demod.h"
+#include "protocols.h"
+#include "../RFControl.h"
+
+/* Prints received messages like the compressed example, followed by
+   "p: id payload" for messages of a protocol in protocols.h.
+
+     rfsniff /dev/gpiochip0 17            receive on line 17
+     rfsniff /dev/gpiochip0 17 -w file    and record the edges to file
+     rfsniff -r file                      replay recorded edges
+     rfsniff -q file [rate]               demodulate an rtl_sdr recording,
+                                          - reads stdin
+ */
+
+// rtl_sdr's default sample rate
+#define SDR_RATE 2048000
+
+// I/Q samples read at once
+#define SDR_CHUNK 65536
+
+void printMessage() {
+  unsigned int *timings;
+  unsigned int timings_size;
+  unsigned int pulse_length_divider = RFControl::getPulseLengthDivider();
+  RFControl::getRaw(&timings, &timings_size);
+  unsigned int buckets[8];
+  bool compressed = RFControl::compressTimings(buckets, timings, timings_size);
+  printf("b: ");
+  for (int i = 0; i < 8; i++) {
+    printf("%lu ", (unsigned long)buckets[i] * pulse_length_divider);
+  }
+  printf("\nt: ");
+  for (unsigned int i = 0; i < timings_size; i++) {
+    putchar('0' + timings[i]);
+  }
+  uint64_t payload = 0;
+  int protocol = -1;
+  if (compressed) {
+    protocol = RFControl::matchProtocol(protocols, sizeof(protocols) / sizeof(protocols[0]), buckets, timings, timings_size, &payload);
+  }
+  if (protocol >= 0) {
+    printf("\np: %d %llx", protocol, (unsigned long long)payload);
+  }
+  printf("\n\n");
+  fflush(stdout);
+  RFControl::continueReceiving();
+}
+
+// Prints the messages completed by the edge just fed to the receiver,
+// before later edges of a large batch can overflow the message buffer
+void printMessages() {
+  while (RFControl::hasData()) {
+    printMessage();
+  }
+}
+
+int demodulate(const char *path, uint32_t rate) {
+  FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (!file) {
+    perror("rfsniff");
+    return 1;
+  }
+  static RFOokDemod demod;
+  static uint8_t iq[2 * SDR_CHUNK];
+  rf_ook_init(&demod, rate);
+  rf_linux_afterEvent(printMessages);
+  RFControl::startReceiving(0);
+  size_t size;
+  while ((size = fread(iq, 2, SDR_CHUNK, file)) > 0) {
+    rf_ook_process(&demod, iq, size);
+  }
+  rf_ook_flush(&demod);
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  int fd;
+  if ((argc == 3 || argc == 4) && strcmp(argv[1], "-q") == 0) {
+    return demodulate(argv[2], argc == 4 ? atol(argv[3]) : SDR_RATE);
+  }
+  if (argc == 3 && strcmp(argv[1], "-r") == 0) {
+    fd = rf_linux_openReplay(argv[2]);
+  }
+  else if (argc == 3 || (argc == 5 && strcmp(argv[3], "-w") == 0)) {
+    fd = rf_linux_openInput(argv[1], atoi(argv[2]));
+    if (argc == 5) {
+      rf_linux_record(open(argv[4], O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    }
+  }
+  else {
+    fprintf(stderr, "usage: %s chip line [-w file] | -r file | -q file [rate]\n", argv[0]);
+    return 2;
+  }
+  if (fd < 0) {
+    perror("rfsniff");
+    return 1;
+  }
+  rf_linux_afterEvent(printMessages);
+  RFControl::startReceiving(0);
+  int count;
+  while ((count = rf_linux_pump(fd)) > 0) {
+    // Messages are printed by printMessages() as their last edge arrives
+  }
+  if (count < 0) {
+    perror("rfsniff");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim_hal.h"
+#include "capture.h"
+#include "../RFControl.h"
+
+/* Host benchmarks of the receiver hot paths, built against the
+   simulator's platform functions:
+
+     isr         per edge
+     getRaw      getRaw() and continueReceiving() per message
+     compress    compressTimings() per message
+     compressSort  compressTimingsAndSortBuckets() per message
+
+   Each benchmark runs BENCH_RUNS times over the whole input and prints
+   one JSON object per line with the median and the fastest run, so
+   results can be compared between releases.
+
+     bench [capture file...]
+
+   Without files a synthetic signal is used, see capture.h for the file
+   formats.
+ */
+
+#define BENCH_RUNS 11
+
+// Edges fed between two clock reads in the isr benchmark
+#define BENCH_CHUNK 256
+
+// Pulses of the input
+unsigned int *pulses;
+size_t pulses_size;
+size_t pulses_capacity;
+
+void addPulse(unsigned int pulse) {
+	if(pulses_size == pulses_capacity) {
+		pulses_capacity = pulses_capacity ? 2 * pulses_capacity : 4096;
+		pulses = (unsigned int*)realloc(pulses, pulses_capacity * sizeof(unsigned int));
+	}
+	pulses[pulses_size++] = pulse;
+}
+
+// 24 bit frames of PT2262 style remotes with some jitter, 4 repeats each
+void syntheticInput() {
+	uint32_t seed = 1;
+	for(int f=0; f < 1000; f++) {
+		uint32_t code = seed = seed * 1103515245 + 12345;
+		for(int r=0; r < 4; r++) {
+			for(int b=0; b < 24; b++) {
+				seed = seed * 1103515245 + 12345;
+				int jitter = (int)(seed >> 16) % 61 - 30;
+				bool one = (code >> b) & 1;
+				addPulse((one ? 1200 : 400) + jitter);
+				addPulse((one ? 400 : 1200) - jitter);
+			}
+			addPulse(400);
+			addPulse(12400);
+		}
+	}
+}
+
+unsigned long long nanos() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Feeds a pulse to the receiver interrupt at its virtual time
+static inline void feed(unsigned long *time, unsigned int pulse) {
+	*time += pulse;
+	sim_now = *time;
+	sim_rxPulses++;
+	sim_interruptCallback();
+}
+
+void resetReceiver() {
+	sim_now = 0;
+	sim_rxPulses = 0;
+	RFControl::startReceiving(0);
+}
+
+// Received messages, collected for the compression benchmarks
+unsigned int *messages;
+size_t *message_sizes;
+size_t messages_size;
+size_t messages_total;
+
+void collectMessage() {
+	unsigned int *timings;
+	unsigned int timings_size;
+	RFControl::getRaw(&timings, &timings_size);
+	message_sizes = (size_t*)realloc(message_sizes, (messages_size + 1) * sizeof(size_t));
+	messages = (unsigned int*)realloc(messages, (messages_total + timings_size) * sizeof(unsigned int));
+	memcpy(messages + messages_total, timings, timings_size * sizeof(unsigned int));
+	message_sizes[messages_size++] = timings_size;
+	messages_total += timings_size;
+	RFControl::continueReceiving();
+}
+
+double benchIsr() {
+	resetReceiver();
+	unsigned long time = 0;
+	unsigned long long elapsed = 0;
+	for(size_t i=0; i < pulses_size; i += BENCH_CHUNK) {
+		size_t end = i + BENCH_CHUNK < pulses_size ? i + BENCH_CHUNK : pulses_size;
+		unsigned long long start = nanos();
+		for(size_t j=i; j < end; j++) {
+			feed(&time, pulses[j]);
+		}
+		elapsed += nanos() - start;
+		while(RFControl::hasData()) {
+			RFControl::continueReceiving();
+		}
+	}
+	return (double)elapsed / pulses_size;
+}
+
+double benchGetRaw() {
+	resetReceiver();
+	unsigned long time = 0;
+	unsigned long long elapsed = 0;
+	size_t count = 0;
+	for(size_t i=0; i < pulses_size; i++) {
+		feed(&time, pulses[i]);
+		if(RFControl::hasData()) {
+			unsigned int *timings;
+			unsigned int timings_size;
+			unsigned long long start = nanos();
+			RFControl::getRaw(&timings, &timings_size);
+			RFControl::continueReceiving();
+			elapsed += nanos() - start;
+			count++;
+		}
+	}
+	return count ? (double)elapsed / count : 0;
+}
+
+double benchCompress(bool sort) {
+	static unsigned int *work;
+	work = (unsigned int*)realloc(work, messages_total * sizeof(unsigned int) + 1);
+	memcpy(work, messages, messages_total * sizeof(unsigned int));
+	unsigned int buckets[8];
+	unsigned long long start = nanos();
+	unsigned int *timings = work;
+	for(size_t i=0; i < messages_size; i++) {
+		if(sort) {
+			RFControl::compressTimingsAndSortBuckets(buckets, timings, message_sizes[i]);
+		}
+		else {
+			RFControl::compressTimings(buckets, timings, message_sizes[i]);
+		}
+		timings += message_sizes[i];
+	}
+	unsigned long long elapsed = nanos() - start;
+	return messages_size ? (double)elapsed / messages_size : 0;
+}
+
+int compareDouble(const void *a, const void *b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+void report(const char *benchmark, const char *input, const char *unit, double *runs) {
+	qsort(runs, BENCH_RUNS, sizeof(double), compareDouble);
+	printf("{\"benchmark\": \"%s\", \"input\": \"%s\", \"unit\": \"%s\", \"median\": %.1f, \"min\": %.1f, \"runs\": %d, \"pulses\": %zu, \"messages\": %zu}\n",
+		benchmark, input, unit, runs[BENCH_RUNS / 2], runs[0], BENCH_RUNS, pulses_size, messages_size);
+}
+
+void benchInput(const char *input) {
+	// Collect the messages once for the compression benchmarks
+	messages_size = 0;
+	messages_total = 0;
+	resetReceiver();
+	unsigned long time = 0;
+	for(size_t i=0; i < pulses_size; i++) {
+		feed(&time, pulses[i]);
+		if(RFControl::hasData()) {
+			collectMessage();
+		}
+	}
+
+	double runs[BENCH_RUNS];
+	for(int r=0; r < BENCH_RUNS; r++) {
+		runs[r] = benchIsr();
+	}
+	report("isr", input, "ns/edge", runs);
+	for(int r=0; r < BENCH_RUNS; r++) {
+		runs[r] = benchGetRaw();
+	}
+	report("getRaw", input, "ns/message", runs);
+	for(int r=0; r < BENCH_RUNS; r++) {
+		runs[r] = benchCompress(false);
+	}
+	report("compress", input, "ns/message", runs);
+	for(int r=0; r < BENCH_RUNS; r++) {
+		runs[r] = benchCompress(true);
+	}
+	report("compressSort", input, "ns/message", runs);
+	fflush(stdout);
+}
+
+int main(int argc, const char *argv[]) {
+	if(argc == 1) {
+		syntheticInput();
+		benchInput("synthetic");
+	}
+	for(int i=1; i < argc; i++) {
+		pulses_size = 0;
+		if(sim_readCapture(argv[i], addPulse) < 0) {
+			perror(argv[i]);
+			return 1;
+		}
+		benchInput(argv[i]);
+	}
+	return 0;
+}
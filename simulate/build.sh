@@ -1,2 +1,15 @@
 #!/bin/sh
-g++ -DRF_CONTROL_SIMULATE_ARDUINO=1 -Wall simulate.cpp -o simulate
+# The library is built as a host object against the simulator's platform
+# functions and linked like any other library
+HAL='-DRF_CONTROL_HAL="sim_hal.h" -I.'
+g++ -Wall -O2 $HAL -c ../RFControl.cpp -o RFControl.o
+g++ -Wall -O2 $HAL -c sim_hal.cpp -o sim_hal.o
+g++ -Wall -O2 -c capture.cpp -o capture.o
+g++ -Wall -O2 -c synth.cpp -o synth.o
+g++ -Wall -O2 $HAL simulate.cpp sim_hal.o capture.o synth.o RFControl.o -o simulate
+g++ -Wall -O2 $HAL bench.cpp sim_hal.o capture.o RFControl.o -o bench
+g++ -Wall -O2 $HAL generate.cpp sim_hal.o synth.o RFControl.o -o generate
+DES='-DRF_CONTROL_HAL="des_hal.h" -I.'
+g++ -Wall -O2 $DES -c ../RFControl.cpp -o RFControl_des.o
+g++ -Wall -O2 -c des.cpp -o des.o
+g++ -Wall -O2 $DES desim.cpp des.o RFControl_des.o -o desim
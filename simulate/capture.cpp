@@ -0,0 +1,83 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+long sim_readCapture(const char *path, void (*feed)(unsigned int pulse)) {
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+	size_t size = st.st_size;
+	long pulses = 0;
+	if(size == 0) {
+		close(fd);
+		return 0;
+	}
+	const uint8_t *data = (const uint8_t*)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		return -1;
+	}
+	madvise((void*)data, size, MADV_SEQUENTIAL);
+	// Text if the first line that is not a comment has only numbers
+	bool text = true;
+	size_t checked = 0;
+	for(size_t i=0; text && i < size && checked < 64; i++) {
+		if(data[i] == '#') {
+			while(i < size && data[i] != '\n') {
+				i++;
+			}
+			continue;
+		}
+		text = isdigit(data[i]) || isspace(data[i]) || data[i] == ',';
+		checked++;
+	}
+	if(text) {
+		unsigned long pulse = 0;
+		bool digits = false;
+		for(size_t i=0; i < size; i++) {
+			if(isdigit(data[i])) {
+				pulse = pulse * 10 + data[i] - '0';
+				digits = true;
+				continue;
+			}
+			if(digits) {
+				feed(pulse);
+				pulses++;
+				pulse = 0;
+				digits = false;
+			}
+			if(data[i] == '#') {
+				while(i < size && data[i] != '\n') {
+					i++;
+				}
+			}
+		}
+		if(digits) {
+			feed(pulse);
+			pulses++;
+		}
+	}
+	else {
+		for(size_t i=0; i + 4 <= size; i += 4) {
+			uint32_t pulse;
+			memcpy(&pulse, data + i, 4);
+			feed(pulse);
+			pulses++;
+		}
+	}
+	munmap((void*)data, size);
+	return pulses;
+}
@@ -0,0 +1,13 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/* Capture files, either text with pulse lengths in micros separated by
+   commas or white space, # starts a comment, or binary with one little
+   endian uint32_t per pulse. The first pulse is high. The file is
+   mapped into memory so long recordings are fed straight from the page
+   cache. Calls feed for each pulse and returns the number of pulses,
+   -1 if the file can not be read.
+ */
+long sim_readCapture(const char *path, void (*feed)(unsigned int pulse));
+
+#endif
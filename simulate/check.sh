@@ -0,0 +1,39 @@
+#!/bin/sh
+# Builds everything and runs the scenario tests, then replays the
+# recordings in captures/ and compares the decoded payloads with the
+# .expected file of each recording. The benchmarks run once over the
+# recordings to check that they still read them.
+cd "$(dirname "$0")"
+./build.sh > /dev/null 2>&1 || { echo "build failed"; exit 1; }
+failed=0
+
+# report name passed
+report() {
+  if [ "$2" = 0 ]; then
+    echo "$1: ok"
+  else
+    echo "$1: failed"
+    failed=1
+  fi
+}
+
+# The test programs exit with 1 if any of their checks failed
+for test in simulate desim; do
+  ./$test > /dev/null 2>&1
+  report $test $?
+done
+
+captures=$(ls captures/*.txt)
+for capture in $captures; do
+  # Mismatches of the streamed compression make simulate exit with 1
+  output=$(./simulate "$capture" 2>&1)
+  status=$?
+  echo "$output" | grep '^protocol:' | diff -u "${capture%.txt}.expected" - &&
+    [ $status = 0 ]
+  report "$capture" $?
+done
+
+count=$(./bench $captures | grep -c '"messages": [1-9]')
+[ "$count" -eq $((4 * $(echo $captures | wc -w))) ]
+report bench $?
+exit $failed
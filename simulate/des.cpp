@@ -0,0 +1,337 @@
+#include <string.h>
+
+#include "des.h"
+
+DesConfig des_config = {
+	4,  // latency
+	4,  // latencyJitter
+	6,  // isrCost
+	1,  // microsCost
+	4,  // writeCost
+	1   // seed
+};
+
+unsigned long des_now;
+DesChannel des_channels[DES_MAX_CHANNELS];
+size_t des_interruptsRun;
+size_t des_interruptsLost;
+
+enum DesEventType {
+	DES_PIN,
+	DES_INTERRUPT,
+	DES_TIMER
+};
+
+struct DesEvent {
+	unsigned long time;
+	// Events at the same time run in the order they were scheduled
+	unsigned long seq;
+	uint8_t type;
+	int8_t pin;
+	int8_t level;
+	unsigned int generation;
+};
+
+// Binary heap ordered by time and seq
+static DesEvent des_events[DES_MAX_EVENTS];
+static size_t des_events_size;
+static unsigned long des_seq;
+
+static int des_pinChannel[DES_MAX_PINS];
+static int des_pinLevel[DES_MAX_PINS];
+
+static void (*des_interruptCallback[DES_MAX_INTERRUPTS])(void);
+// Attaching and detaching invalidates interrupts already raised
+static unsigned int des_interruptGeneration[DES_MAX_INTERRUPTS];
+static bool des_interruptPending[DES_MAX_INTERRUPTS];
+
+static void (*des_timerCallback)(void);
+static unsigned long des_timerDeadline;
+static unsigned int des_timerGeneration;
+static bool des_timerRunning;
+static bool des_timerPending;
+
+static bool des_enabled;
+static bool des_inInterrupt;
+static bool des_dispatching;
+static uint32_t des_state;
+
+static uint32_t des_random() {
+	des_state ^= des_state << 13;
+	des_state ^= des_state >> 17;
+	des_state ^= des_state << 5;
+	return des_state;
+}
+
+static bool des_before(const DesEvent *a, const DesEvent *b) {
+	return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void des_push(unsigned long time, uint8_t type, int pin, int level, unsigned int generation) {
+	if(des_events_size == DES_MAX_EVENTS) {
+		return;
+	}
+	DesEvent event = {time, des_seq++, type, (int8_t)pin, (int8_t)level, generation};
+	size_t i = des_events_size++;
+	while(i > 0 && des_before(&event, &des_events[(i - 1) / 2])) {
+		des_events[i] = des_events[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	des_events[i] = event;
+}
+
+static DesEvent des_pop() {
+	DesEvent top = des_events[0];
+	DesEvent last = des_events[--des_events_size];
+	size_t i = 0;
+	for(;;) {
+		size_t child = 2 * i + 1;
+		if(child >= des_events_size) {
+			break;
+		}
+		if(child + 1 < des_events_size && des_before(&des_events[child + 1], &des_events[child])) {
+			child++;
+		}
+		if(!des_before(&des_events[child], &last)) {
+			break;
+		}
+		des_events[i] = des_events[child];
+		i = child;
+	}
+	des_events[i] = last;
+	return top;
+}
+
+static unsigned long des_latency() {
+	return des_config.latency + des_random() % (des_config.latencyJitter + 1);
+}
+
+void des_reset() {
+	des_now = 0;
+	des_events_size = 0;
+	des_seq = 0;
+	memset(des_channels, 0, sizeof(des_channels));
+	for(int i=0; i < DES_MAX_PINS; i++) {
+		des_pinChannel[i] = -1;
+		des_pinLevel[i] = 0;
+	}
+	for(int i=0; i < DES_MAX_INTERRUPTS; i++) {
+		des_interruptCallback[i] = 0;
+		des_interruptGeneration[i]++;
+		des_interruptPending[i] = false;
+	}
+	des_timerRunning = false;
+	des_timerPending = false;
+	des_timerGeneration++;
+	des_enabled = true;
+	des_inInterrupt = false;
+	des_interruptsRun = 0;
+	des_interruptsLost = 0;
+	des_state = des_config.seed ? des_config.seed : 1;
+}
+
+void des_connect(int pin, int channel) {
+	des_pinChannel[pin] = channel;
+}
+
+// Sets the level of a pin and of its channel, an edge on the channel
+// raises the interrupts of the pins connected to it
+static void des_setPin(int pin, int level) {
+	if(des_pinLevel[pin] == level) {
+		return;
+	}
+	des_pinLevel[pin] = level;
+	int c = des_pinChannel[pin];
+	if(c < 0) {
+		return;
+	}
+	DesChannel *channel = &des_channels[c];
+	int others = 0;
+	for(int i=0; i < DES_MAX_PINS; i++) {
+		if(i != pin && des_pinChannel[i] == c) {
+			others |= des_pinLevel[i];
+		}
+	}
+	if(level && others) {
+		channel->collisions++;
+	}
+	if((level | others) == channel->level) {
+		return;
+	}
+	channel->level = level | others;
+	if(channel->edges_size < DES_MAX_CHANNEL_EDGES) {
+		channel->edges[channel->edges_size++] = des_now;
+	}
+	for(int i=0; i < DES_MAX_INTERRUPTS; i++) {
+		if(des_interruptCallback[i] && des_pinChannel[i + 2] == c) {
+			des_push(des_now + des_latency(), DES_INTERRUPT, i, 0, des_interruptGeneration[i]);
+		}
+	}
+}
+
+void des_schedulePin(unsigned long time, int pin, int level) {
+	des_push(time, DES_PIN, pin, level, 0);
+}
+
+unsigned long des_schedulePulses(unsigned long time, int pin, const unsigned int *pulses, size_t pulses_size) {
+	for(size_t i=0; i < pulses_size; i++) {
+		des_schedulePin(time, pin, i % 2 == 0);
+		time += pulses[i];
+	}
+	des_schedulePin(time, pin, 0);
+	return time;
+}
+
+static void des_interrupt(void (*callback)(void)) {
+	des_inInterrupt = true;
+	des_now += des_config.isrCost / 2;
+	callback();
+	des_now += des_config.isrCost - des_config.isrCost / 2;
+	des_inInterrupt = false;
+	des_interruptsRun++;
+}
+
+// Runs the interrupts that were held back, the timer first like on the AVR
+static void des_runPending() {
+	while(des_enabled) {
+		if(des_timerPending) {
+			des_timerPending = false;
+			if(des_timerRunning) {
+				des_interrupt(des_timerCallback);
+			}
+			continue;
+		}
+		int i = 0;
+		while(i < DES_MAX_INTERRUPTS && !des_interruptPending[i]) {
+			i++;
+		}
+		if(i == DES_MAX_INTERRUPTS) {
+			return;
+		}
+		des_interruptPending[i] = false;
+		if(des_interruptCallback[i]) {
+			des_interrupt(des_interruptCallback[i]);
+		}
+	}
+}
+
+static void des_dispatch(const DesEvent *event) {
+	switch(event->type) {
+	case DES_PIN:
+		des_setPin(event->pin, event->level);
+		break;
+	case DES_INTERRUPT:
+		if(event->generation == des_interruptGeneration[event->pin]) {
+			if(des_interruptPending[event->pin]) {
+				des_interruptsLost++;
+			}
+			des_interruptPending[event->pin] = true;
+		}
+		break;
+	case DES_TIMER:
+		if(event->generation == des_timerGeneration && des_timerRunning) {
+			des_timerPending = true;
+		}
+		break;
+	}
+}
+
+/* Advances the main context to time. Interrupts that run meanwhile
+   take time of their own, so the clock can end up past time. Within an
+   interrupt the clock only advances, the events wait until it returns.
+ */
+void des_runUntil(unsigned long time) {
+	if(des_inInterrupt || des_dispatching) {
+		if(time > des_now) {
+			des_now = time;
+		}
+		return;
+	}
+	des_dispatching = true;
+	for(;;) {
+		des_runPending();
+		unsigned long limit = time > des_now ? time : des_now;
+		if(des_events_size == 0 || des_events[0].time > limit) {
+			break;
+		}
+		DesEvent event = des_pop();
+		if(event.time > des_now) {
+			des_now = event.time;
+		}
+		des_dispatch(&event);
+	}
+	if(time > des_now) {
+		des_now = time;
+	}
+	des_dispatching = false;
+}
+
+void des_run() {
+	while(des_events_size > 0) {
+		des_runUntil(des_events[0].time);
+	}
+	des_runUntil(des_now);
+}
+
+unsigned long des_micros() {
+	unsigned long now = des_now;
+	des_runUntil(des_now + des_config.microsCost);
+	return now;
+}
+
+void des_delay(unsigned long micros) {
+	des_runUntil(des_now + micros);
+}
+
+void des_write(int pin, int level) {
+	des_runUntil(des_now + des_config.writeCost);
+	des_setPin(pin, level);
+}
+
+int des_read(int pin) {
+	int c = des_pinChannel[pin];
+	return c < 0 ? des_pinLevel[pin] : des_channels[c].level;
+}
+
+void des_attachInterrupt(int interrupt, void (*callback)(void)) {
+	des_interruptCallback[interrupt] = callback;
+	des_interruptGeneration[interrupt]++;
+	des_interruptPending[interrupt] = false;
+}
+
+void des_detachInterrupt(int interrupt) {
+	des_interruptCallback[interrupt] = 0;
+	des_interruptGeneration[interrupt]++;
+	des_interruptPending[interrupt] = false;
+}
+
+void des_disableInterrupts() {
+	des_enabled = false;
+}
+
+void des_enableInterrupts() {
+	des_enabled = true;
+	des_runUntil(des_now);
+}
+
+void des_timerStart(void (*callback)(void)) {
+	des_timerCallback = callback;
+	des_timerDeadline = des_now;
+	des_timerGeneration++;
+	des_timerRunning = true;
+	des_timerPending = false;
+}
+
+// Relative to the previous deadline, a deadline in the past fires at once
+void des_timerSchedule(unsigned long delay) {
+	des_timerDeadline += delay;
+	des_timerGeneration++;
+	unsigned long time = des_timerDeadline > des_now ? des_timerDeadline : des_now;
+	des_push(time + des_latency(), DES_TIMER, 0, 0, des_timerGeneration);
+}
+
+void des_timerStop() {
+	des_timerRunning = false;
+	des_timerPending = false;
+	des_timerGeneration++;
+}
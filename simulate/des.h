@@ -0,0 +1,87 @@
+#ifndef DES_H
+#define DES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Discrete event simulator with a virtual clock in micros. The library
+   runs in the main context until it calls a platform function that
+   takes time: hw_micros(), hw_delayMicroseconds() and hw_digitalWrite()
+   advance the clock and run the events that fall due meanwhile. Those
+   include edges of scripted transmitters, interrupts and the timer.
+
+   Pins are connected to channels. The level of a channel is the OR of
+   the levels of the pins transmitting on it, so several transmitters,
+   the library's own included, can share a channel. Every edge on a
+   channel raises the interrupts attached to pins on that channel after
+   a random latency. Interrupts are held back while interrupts are
+   disabled or another interrupt runs. Like on the AVR, an interrupt
+   raised several times meanwhile runs only once, and reads the level
+   the channel has by then.
+ */
+
+#define DES_MAX_PINS 32
+#define DES_MAX_CHANNELS 4
+#define DES_MAX_EVENTS 8192
+#define DES_MAX_CHANNEL_EDGES 4096
+
+// hw_attachInterrupt() numbers, interrupt n reads pin n + 2
+#define DES_MAX_INTERRUPTS 2
+
+struct DesConfig {
+	// Delay from an edge or timer deadline to its interrupt, plus a
+	// random part up to latencyJitter
+	unsigned int latency;
+	unsigned int latencyJitter;
+	// Entry and exit of an interrupt handler
+	unsigned int isrCost;
+	unsigned int microsCost;
+	unsigned int writeCost;
+	uint32_t seed;
+};
+
+struct DesChannel {
+	int level;
+	// Times a transmitter switched on while another one was on
+	size_t collisions;
+	unsigned long edges[DES_MAX_CHANNEL_EDGES];
+	size_t edges_size;
+};
+
+extern DesConfig des_config;
+extern unsigned long des_now;
+extern DesChannel des_channels[DES_MAX_CHANNELS];
+extern size_t des_interruptsRun;
+extern size_t des_interruptsLost;
+
+// Clears the events and channels and sets the clock to 0
+void des_reset();
+
+// Connects pin to channel, -1 disconnects it
+void des_connect(int pin, int channel);
+
+// Scripted transmitter, sets pin to level at time
+void des_schedulePin(unsigned long time, int pin, int level);
+
+// Scripted frame on pin starting at time, the first pulse is high,
+// returns the time after the last pulse
+unsigned long des_schedulePulses(unsigned long time, int pin, const unsigned int *pulses, size_t pulses_size);
+
+// Runs the main context until time, or until there are no more events
+void des_runUntil(unsigned long time);
+void des_run();
+
+// Platform functions, see des_hal.h
+unsigned long des_micros();
+void des_delay(unsigned long micros);
+void des_write(int pin, int level);
+int des_read(int pin);
+void des_attachInterrupt(int interrupt, void (*callback)(void));
+void des_detachInterrupt(int interrupt);
+void des_disableInterrupts();
+void des_enableInterrupts();
+void des_timerStart(void (*callback)(void));
+void des_timerSchedule(unsigned long delay);
+void des_timerStop();
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef DES_HAL_H
+#define DES_HAL_H
+
+/* Platform functions for the discrete event simulator, see des.h.
+   RFControl.cpp includes this in place of arduino_functions.h when
+   built with -DRF_CONTROL_HAL='"des_hal.h"'. Unlike sim_hal.h, time
+   only passes in the platform functions and interrupts are delivered
+   by the simulator, so transmit and receive run together.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "des.h"
+
+#define byte uint8_t
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#ifndef MAX_RECORDINGS
+#define MAX_RECORDINGS 512
+#endif
+
+static inline void hw_attachInterrupt(int interrupt, void (*callback)(void)) {
+  des_attachInterrupt(interrupt, callback);
+}
+
+static inline void hw_detachInterrupt(int interrupt) {
+  des_detachInterrupt(interrupt);
+}
+
+static inline unsigned long hw_micros() {
+  return des_micros();
+}
+
+static inline void hw_delayMicroseconds(uint32_t time_to_wait) {
+  des_delay(time_to_wait);
+}
+
+static inline void hw_pinMode(int, int) {
+}
+
+static inline void hw_digitalWrite(int pin, int value) {
+  des_write(pin, value);
+}
+
+static inline int hw_digitalRead(int pin) {
+  return des_read(pin);
+}
+
+static inline void hw_readProgmem(void *dst, const void *src, size_t size) {
+  memcpy(dst, src, size);
+}
+
+static inline uint8_t hw_readProgmemByte(const void *src) {
+  return *(const uint8_t*)src;
+}
+
+static inline uint16_t hw_readProgmemWord(const void *src) {
+  return *(const uint16_t*)src;
+}
+
+static inline uint32_t hw_random(uint32_t max) {
+  return max ? rand() % max : 0;
+}
+
+static inline void hw_noInterrupts() {
+  des_disableInterrupts();
+}
+
+static inline void hw_interrupts() {
+  des_enableInterrupts();
+}
+
+#define HW_HAS_TIMER 1
+#define HW_TIMER_MAX_DELAY 30000
+#define HW_TICKS_PER_US 1
+
+static inline void hw_timerStart(void (*callback)(void)) {
+  des_timerStart(callback);
+}
+
+static inline void hw_timerSchedule(uint32_t delay) {
+  des_timerSchedule(delay);
+}
+
+static inline void hw_timerScheduleTicks(uint16_t ticks) {
+  des_timerSchedule(ticks);
+}
+
+static inline void hw_timerStop() {
+  des_timerStop();
+}
+
+// Pin writes of compiled programs go through hw_digitalWrite()
+static inline void *hw_pinPort(int) {
+  return 0;
+}
+
+static inline uint32_t hw_pinMask(int pin) {
+  return pin;
+}
+
+static inline void hw_portWrite(void *, uint32_t mask, int value) {
+  hw_digitalWrite(mask, value);
+}
+
+#endif
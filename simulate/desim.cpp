@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "des_hal.h"
+#include "../RFControl.h"
+
+/* Scenarios for the discrete event simulator, see des.h. The library
+   receives on interrupt 0, i.e. pin 2, and transmits on pin 4. Other
+   senders are scripted on pins 10 and 11. Prints one line per scenario
+   ending in ok or failed, and exits with 1 if any failed.
+
+     desim [latency [jitter]]
+ */
+
+#define RX_INTERRUPT 0
+#define RX_PIN (RX_INTERRUPT + 2)
+#define TX_PIN 4
+#define OTHER_PIN 10
+#define SECOND_PIN 11
+
+#define FRAME_SIZE 50
+
+// Scenarios that failed, main() exits with 1 if there are any
+int failed = 0;
+
+const char *verdict(bool ok) {
+	if(!ok) {
+		failed++;
+	}
+	return ok ? "ok" : "failed";
+}
+
+// 24 bit frame of a PT2262 style remote with its sync
+void makeFrame(unsigned int frame[FRAME_SIZE], uint32_t code) {
+	for(int i=0; i < 24; i++) {
+		bool one = (code >> i) & 1;
+		frame[2 * i] = one ? 1200 : 400;
+		frame[2 * i + 1] = one ? 400 : 1200;
+	}
+	frame[48] = 400;
+	frame[49] = 12400;
+}
+
+// Sends the frame repeats times on pin from time, returns the end
+unsigned long scheduleFrames(unsigned long time, int pin, const unsigned int frame[FRAME_SIZE], unsigned int repeats) {
+	for(unsigned int r=0; r < repeats; r++) {
+		time = des_schedulePulses(time, pin, frame, FRAME_SIZE);
+	}
+	return time;
+}
+
+void setup() {
+	des_reset();
+	des_connect(RX_PIN, 0);
+	des_connect(TX_PIN, 0);
+	des_connect(OTHER_PIN, 0);
+	des_connect(SECOND_PIN, 1);
+	RFControl::disableReceiveWhileSending();
+	RFControl::startReceiving(RX_INTERRUPT);
+	RFControl::resetTransmitStats();
+}
+
+// Checks the pulses of a received message against the frame
+bool matchesFrame(const unsigned int frame[FRAME_SIZE]) {
+	unsigned int *timings;
+	unsigned int timings_size;
+	RFControl::getRaw(&timings, &timings_size);
+	unsigned int divider = RFControl::getPulseLengthDivider();
+	bool same = timings_size == FRAME_SIZE;
+	for(unsigned int i=0; same && i < timings_size; i++) {
+		long error = (long)(timings[i] * divider) - (long)frame[i];
+		// The sync of the last repeat runs into the silence after it
+		same = labs(error) < frame[i] / 8 || (i == FRAME_SIZE - 1 && error > 0);
+	}
+	RFControl::continueReceiving();
+	return same;
+}
+
+// Runs the simulation in steps until end, counts the messages that
+// match the frame
+int receiveFrames(unsigned long end, const unsigned int frame[FRAME_SIZE], int *mismatches) {
+	int matched = 0;
+	while(des_now < end) {
+		des_runUntil(des_now + 1000);
+		while(RFControl::hasData()) {
+			if(matchesFrame(frame)) {
+				matched++;
+			}
+			else {
+				(*mismatches)++;
+			}
+		}
+	}
+	return matched;
+}
+
+// Largest difference between the edges on a channel and the timings,
+// from edge first on. The last low pulse has no edge after it.
+long edgeError(int channel, size_t first, const unsigned int *timings, size_t timings_size) {
+	const DesChannel *c = &des_channels[channel];
+	if(c->edges_size < first + timings_size) {
+		return -1;
+	}
+	long worst = 0;
+	for(size_t i=0; i + 1 < timings_size; i++) {
+		long error = labs((long)(c->edges[first + i + 1] - c->edges[first + i]) - (long)timings[i]);
+		if(error > worst) {
+			worst = error;
+		}
+	}
+	return worst;
+}
+
+// Another sender's frame, received with interrupt latency
+void receive() {
+	unsigned int frame[FRAME_SIZE];
+	makeFrame(frame, 0x5a5a5a);
+	setup();
+	unsigned long end = scheduleFrames(1000, OTHER_PIN, frame, 4);
+	des_schedulePin(end + 20000, OTHER_PIN, 1);
+	des_schedulePin(end + 20400, OTHER_PIN, 0);
+	int mismatches = 0;
+	int matched = receiveFrames(end + 30000, frame, &mismatches);
+	// The first frame has no sync before it
+	printf("receive: %d messages, %d mismatches, %zu interrupts, %s\n", matched, mismatches,
+		des_interruptsRun, verdict(matched == 3 && mismatches == 0));
+}
+
+// Blocking send on channel 1 while the receiver takes interrupts from
+// traffic on channel 0
+void transmit() {
+	unsigned int frame[FRAME_SIZE];
+	makeFrame(frame, 0x123456);
+	// A different period, so the interrupts drift across our edges
+	for(int i=0; i < FRAME_SIZE; i++) {
+		frame[i] = frame[i] * 5 / 6;
+	}
+	unsigned int timings[FRAME_SIZE];
+	makeFrame(timings, 0xabcdef);
+	setup();
+	des_connect(TX_PIN, 1);
+	RFControl::enableReceiveWhileSending();
+	unsigned long start = des_now + 500;
+	scheduleFrames(start, OTHER_PIN, frame, 12);
+	RFControl::sendByTimings(TX_PIN, timings, FRAME_SIZE, 8);
+	long error = 0;
+	for(int r=0; r < 8; r++) {
+		long repeat = edgeError(1, r * FRAME_SIZE, timings, FRAME_SIZE);
+		error = repeat < 0 || error < 0 ? -1 : (repeat > error ? repeat : error);
+	}
+	size_t interrupts = des_interruptsRun;
+	// An edge can wait for one interrupt and the write after it
+	long bound = des_config.isrCost + des_config.microsCost + des_config.writeCost + 2;
+	printf("transmit: max error %ld us with %zu interrupts, %s\n", error, interrupts,
+		verdict(error >= 0 && error <= bound && interrupts > 0));
+	RFControl::disableReceiveWhileSending();
+}
+
+bool sent;
+
+void sendDone() {
+	sent = true;
+}
+
+void queueDone(int id) {
+	sent = true;
+}
+
+// Asynchronous send from the timer interrupt, the edges arrive late by
+// the timer latency only
+void async() {
+	unsigned int timings[FRAME_SIZE];
+	makeFrame(timings, 0x0f0f0f);
+	setup();
+	sent = false;
+	RFControl::sendAsync(TX_PIN, timings, FRAME_SIZE, 1, sendDone);
+	des_run();
+	long error = edgeError(0, 0, timings, FRAME_SIZE);
+	long bound = des_config.latencyJitter + des_config.isrCost + des_config.writeCost + des_config.microsCost + 2;
+	printf("async: max error %ld us, %s\n", error,
+		verdict(sent && error >= 0 && error <= bound));
+}
+
+// Queued send while another sender repeats a frame on the same channel,
+// the library must not transmit over it
+void csma() {
+	unsigned int frame[FRAME_SIZE];
+	makeFrame(frame, 0x333333);
+	unsigned int timings[] = { 400, 1200, 400, 12400 };
+	setup();
+	unsigned long end = scheduleFrames(1000, OTHER_PIN, frame, 4);
+	// Carrier sense needs the sync of the first repeat
+	des_runUntil(1000 + 51200 + 20000);
+	sent = false;
+	RFControl::queueSend(TX_PIN, timings, 4, 1, 0, 0, queueDone);
+	des_run();
+	RFTransmitStats stats;
+	RFControl::getTransmitStats(&stats);
+	const DesChannel *channel = &des_channels[0];
+	// A first edge before the end of the frames is a collision as well
+	long after = (long)(channel->edges[4 * FRAME_SIZE] - end);
+	size_t collisions = channel->collisions + (after > 0 ? 0 : 1);
+	printf("csma: first edge %ld us after the frames, %zu collisions, %s\n", after,
+		collisions, verdict(sent && collisions == 0 && stats.deferred == 1));
+}
+
+// A sender on channel 1 does not hold back a send on channel 0
+void channels() {
+	unsigned int frame[FRAME_SIZE];
+	makeFrame(frame, 0x333333);
+	unsigned int timings[] = { 400, 1200, 400, 12400 };
+	setup();
+	scheduleFrames(1000, SECOND_PIN, frame, 4);
+	des_runUntil(1000 + 40000);
+	unsigned long start = des_now;
+	sent = false;
+	RFControl::queueSend(TX_PIN, timings, 4, 1, 0, 0, queueDone);
+	des_run();
+	RFTransmitStats stats;
+	RFControl::getTransmitStats(&stats);
+	unsigned long first = des_channels[0].edges[0];
+	printf("channels: first edge %lu us after the call, %s\n", first - start,
+		verdict(sent && stats.deferred == 0 && first - start < 1000 && des_channels[1].edges_size == 4 * FRAME_SIZE));
+}
+
+// Receive on channel 0 while sending on channel 1 from the timer
+void duplex() {
+	unsigned int frame[FRAME_SIZE];
+	makeFrame(frame, 0x246813);
+	unsigned int timings[FRAME_SIZE];
+	makeFrame(timings, 0x13579b);
+	setup();
+	des_connect(TX_PIN, 1);
+	// The receiver does not hear the transmitter, there are no echoes
+	RFControl::enableReceiveWhileSending(1);
+	unsigned long end = scheduleFrames(1000, OTHER_PIN, frame, 4);
+	des_schedulePin(end + 20000, OTHER_PIN, 1);
+	des_schedulePin(end + 20400, OTHER_PIN, 0);
+	des_runUntil(2000);
+	sent = false;
+	RFControl::sendAsync(TX_PIN, timings, FRAME_SIZE, 3, sendDone);
+	int mismatches = 0;
+	int matched = receiveFrames(end + 30000, frame, &mismatches);
+	des_run();
+	long error = edgeError(1, 0, timings, FRAME_SIZE);
+	// A timer interrupt can also wait for a receiver interrupt
+	long bound = des_config.latencyJitter + 2 * des_config.isrCost + des_config.writeCost + 3 * des_config.microsCost + 2;
+	printf("duplex: %d messages, max error %ld us, %s\n", matched, error,
+		verdict(sent && matched == 3 && mismatches == 0 && error >= 0 && error <= bound));
+	RFControl::disableReceiveWhileSending();
+}
+
+int main(int argc, const char *argv[]) {
+	if(argc > 1) {
+		des_config.latency = atoi(argv[1]);
+	}
+	if(argc > 2) {
+		des_config.latencyJitter = atoi(argv[2]);
+	}
+	receive();
+	transmit();
+	async();
+	csma();
+	channels();
+	duplex();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_hal.h"
+#include "synth.h"
+#include "../RFControl.h"
+
+/* Measures the capture rate on synthetic signals, see synth.h. Every
+   message the receiver delivers is assigned to the frame it overlaps
+   most. A frame is recovered when a message has the same number of
+   pulses and its bucket indices map one to one to the frame's nominal
+   pulse classes.
+
+     generate [options]
+
+     -p protocol      pt2262, manchester or distance
+     -t period        in micros, default depends on the protocol
+     -b bits          payload bits per frame, default 24
+     -n count         transmissions, default 250
+     -r repeats       frames per transmission, default 4
+     -d percent       max clock offset of a transmission
+     -J micros        max edge jitter
+     -g rate          glitches per second
+     -x percent       high pulses lost
+     -f percent       transmissions preceded by a foreign sender
+     -s seed          random seed, default 1
+     -w file          also write the signal as a binary capture file
+
+   Prints one line with the totals.
+ */
+
+// Frames ending this long before the start of a message are not
+// considered for it, the start is estimated from the decoded timings
+#define GENERATE_SLACK 100000
+
+struct GenerateResult {
+	size_t frames;
+	size_t recovered;
+	size_t transmissions;
+	size_t transmissionsRecovered;
+	size_t foreign;
+	size_t foreignRecovered;
+	size_t messages;
+	size_t garbled;
+	size_t spurious;
+};
+
+// Checks the compressed message against the frame's pulse classes
+bool exact(const SynthFrame *frame, const unsigned int *indices, unsigned int size) {
+	if(size != frame->size) {
+		return false;
+	}
+	int toClass[8];
+	int toIndex[SYNTH_MAX_FRAME];
+	for(int i=0; i < 8; i++) {
+		toClass[i] = -1;
+	}
+	for(int i=0; i < SYNTH_MAX_FRAME; i++) {
+		toIndex[i] = -1;
+	}
+	for(unsigned int i=0; i < size; i++) {
+		unsigned int index = indices[i];
+		unsigned int c = frame->classes[i];
+		if(toClass[index] == -1 && toIndex[c] == -1) {
+			toClass[index] = c;
+			toIndex[c] = index;
+		}
+		else if(toClass[index] != (int)c || toIndex[c] != (int)index) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void evaluate(const SynthSignal *signal, GenerateResult *result) {
+	memset(result, 0, sizeof(GenerateResult));
+	bool *recovered = (bool*)calloc(signal->frames_size, sizeof(bool));
+	unsigned int divider = RFControl::getPulseLengthDivider();
+	size_t first = 0;
+	unsigned long time = 0;
+
+	sim_now = 0;
+	sim_rxPulses = 0;
+	RFControl::startReceiving(0);
+	for(size_t i=0; i < signal->pulses_size; i++) {
+		time += signal->pulses[i];
+		sim_now = time;
+		sim_rxPulses++;
+		sim_interruptCallback();
+		if(!RFControl::hasData()) {
+			continue;
+		}
+		result->messages++;
+		unsigned int *timings;
+		unsigned int timings_size;
+		RFControl::getRaw(&timings, &timings_size);
+		unsigned long duration = 0;
+		for(unsigned int j=0; j < timings_size; j++) {
+			duration += timings[j] * divider;
+		}
+		unsigned long start = duration < time ? time - duration : 0;
+
+		// Frames are ordered by time, skip those long before the message
+		while(first < signal->frames_size && signal->frames[first].end + GENERATE_SLACK < start) {
+			first++;
+		}
+		long best = -1;
+		long bestOverlap = 0;
+		for(size_t f=first; f < signal->frames_size && signal->frames[f].start < time; f++) {
+			const SynthFrame *frame = &signal->frames[f];
+			long overlap = (long)(frame->end < time ? frame->end : time) - (long)(frame->start > start ? frame->start : start);
+			if(overlap > bestOverlap) {
+				best = f;
+				bestOverlap = overlap;
+			}
+		}
+
+		unsigned int buckets[8];
+		bool compressed = RFControl::compressTimings(buckets, timings, timings_size);
+		if(best < 0) {
+			result->spurious++;
+		}
+		else if(compressed && !recovered[best] && exact(&signal->frames[best], timings, timings_size)) {
+			recovered[best] = true;
+		}
+		else {
+			result->garbled++;
+		}
+		RFControl::continueReceiving();
+	}
+
+	long transmission = -1;
+	bool any = false;
+	for(size_t f=0; f < signal->frames_size; f++) {
+		const SynthFrame *frame = &signal->frames[f];
+		if(frame->foreign) {
+			result->foreign++;
+			result->foreignRecovered += recovered[f];
+			continue;
+		}
+		if((long)frame->transmission != transmission) {
+			result->transmissionsRecovered += any;
+			transmission = frame->transmission;
+			result->transmissions++;
+			any = false;
+		}
+		result->frames++;
+		result->recovered += recovered[f];
+		any |= recovered[f];
+	}
+	result->transmissionsRecovered += any;
+	free(recovered);
+}
+
+// Binary capture file, one little endian uint32_t per pulse
+bool writeCapture(const char *path, const SynthSignal *signal) {
+	FILE *file = fopen(path, "wb");
+	if(!file) {
+		return false;
+	}
+	for(size_t i=0; i < signal->pulses_size; i++) {
+		uint32_t pulse = signal->pulses[i];
+		uint8_t bytes[4] = {(uint8_t)pulse, (uint8_t)(pulse >> 8), (uint8_t)(pulse >> 16), (uint8_t)(pulse >> 24)};
+		fwrite(bytes, 1, 4, file);
+	}
+	return fclose(file) == 0;
+}
+
+double percent(size_t part, size_t total) {
+	return total ? 100.0 * part / total : 0;
+}
+
+int main(int argc, const char *argv[]) {
+	SynthOptions options;
+	synth_defaults(&options);
+	const char *output = 0;
+	for(int i=1; i < argc; i += 2) {
+		if(argv[i][0] != '-' || strlen(argv[i]) != 2 || i + 1 == argc) {
+			fprintf(stderr, "usage: generate [-p protocol] [-t period] [-b bits] [-n count] [-r repeats]\n"
+				"                [-d percent] [-J micros] [-g rate] [-x percent] [-f percent]\n"
+				"                [-s seed] [-w file]\n");
+			return 1;
+		}
+		const char *value = argv[i + 1];
+		switch(argv[i][1]) {
+		case 'p': {
+			int protocol = synth_protocol(value);
+			if(protocol < 0) {
+				fprintf(stderr, "unknown protocol %s\n", value);
+				return 1;
+			}
+			options.protocol = (SynthProtocol)protocol;
+			break;
+		}
+		case 't': options.period = atoi(value); break;
+		case 'b': options.bits = atoi(value); break;
+		case 'n': options.transmissions = atoi(value); break;
+		case 'r': options.repeats = atoi(value); break;
+		case 'd': options.drift = atof(value); break;
+		case 'J': options.jitter = atoi(value); break;
+		case 'g': options.glitches = atof(value); break;
+		case 'x': options.dropouts = atof(value); break;
+		case 'f': options.foreign = atof(value); break;
+		case 's': options.seed = strtoul(value, 0, 0); break;
+		case 'w': output = value; break;
+		default:
+			fprintf(stderr, "unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if(options.bits == 0 || options.bits > SYNTH_MAX_BITS) {
+		fprintf(stderr, "bits must be 1 to %d\n", SYNTH_MAX_BITS);
+		return 1;
+	}
+
+	SynthSignal signal;
+	synth_generate(&options, &signal);
+	if(output && !writeCapture(output, &signal)) {
+		perror(output);
+		return 1;
+	}
+	GenerateResult result;
+	evaluate(&signal, &result);
+	printf("%s: %zu frames, %zu recovered (%.1f %%), %zu of %zu transmissions, "
+		"%zu messages, %zu garbled, %zu spurious, %zu foreign frames, %zu recovered\n",
+		synth_protocolNames[options.protocol], result.frames, result.recovered,
+		percent(result.recovered, result.frames), result.transmissionsRecovered,
+		result.transmissions, result.messages, result.garbled, result.spurious,
+		result.foreign, result.foreignRecovered);
+	synth_free(&signal);
+	return 0;
+}
@@ -0,0 +1,20 @@
+#include "sim_hal.h"
+
+// Receiver interrupt
+void (*sim_interruptCallback)(void);
+
+// Virtual time in microseconds
+unsigned long sim_now = 0;
+
+// Received pulses, the receiver level follows from their count
+size_t sim_rxPulses = 0;
+
+// Virtual timer for the asynchronous transmitter
+void (*sim_timerCallback)(void);
+bool sim_timerRunning = false;
+unsigned long sim_timerDeadline;
+
+// Transmitted edges
+unsigned long sim_edges[SIM_MAX_EDGES];
+size_t sim_edges_size = 0;
+int sim_txLevel = 0;
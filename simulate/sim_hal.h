@@ -0,0 +1,138 @@
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+/* Platform functions for the simulator. RFControl.cpp includes this in
+   place of arduino_functions.h when built with
+   -DRF_CONTROL_HAL='"sim_hal.h"', so the library compiles as a plain
+   host object against the simulator's virtual clock, pins and timer.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define byte uint8_t
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#ifndef MAX_RECORDINGS
+#define MAX_RECORDINGS 512
+#endif
+
+// Virtual cost of hw_digitalWrite(), reading hw_micros() costs 1 us
+#define SIM_WRITE_COST 4
+
+// Transmitted edges
+#define SIM_MAX_EDGES 1024
+
+// Simulator state, defined in sim_hal.cpp so every program built on
+// the simulator links the same clock, pins and timer
+extern void (*sim_interruptCallback)(void);
+extern unsigned long sim_now;
+extern size_t sim_rxPulses;
+extern void (*sim_timerCallback)(void);
+extern bool sim_timerRunning;
+extern unsigned long sim_timerDeadline;
+extern unsigned long sim_edges[SIM_MAX_EDGES];
+extern size_t sim_edges_size;
+extern int sim_txLevel;
+
+static inline void hw_attachInterrupt(int, void (*callback)(void)) {
+  sim_interruptCallback = callback;
+}
+
+static inline void hw_detachInterrupt(int) {
+  sim_interruptCallback = 0;
+}
+
+static inline unsigned long hw_micros() {
+  return sim_now++;
+}
+
+static inline void hw_delayMicroseconds(uint32_t time_to_wait) {
+  sim_now += time_to_wait;
+}
+
+static inline void hw_pinMode(int, int) {
+}
+
+static inline void hw_digitalWrite(int, int value) {
+  sim_now += SIM_WRITE_COST;
+  if (value != sim_txLevel && sim_edges_size < SIM_MAX_EDGES) {
+    sim_edges[sim_edges_size++] = sim_now;
+  }
+  sim_txLevel = value;
+}
+
+// Level after the last received pulse, the first pulse is high
+static inline int hw_digitalRead(int) {
+  return (sim_rxPulses & 1) == 0;
+}
+
+static inline void hw_readProgmem(void *dst, const void *src, size_t size) {
+  memcpy(dst, src, size);
+}
+
+static inline uint8_t hw_readProgmemByte(const void *src) {
+  return *(const uint8_t*)src;
+}
+
+static inline uint16_t hw_readProgmemWord(const void *src) {
+  return *(const uint16_t*)src;
+}
+
+static inline uint32_t hw_random(uint32_t max) {
+  return max ? rand() % max : 0;
+}
+
+static inline void hw_noInterrupts() {
+}
+
+static inline void hw_interrupts() {
+}
+
+// Virtual timer, simulate.cpp runs the callback at sim_timerDeadline
+#define HW_HAS_TIMER 1
+#define HW_TIMER_MAX_DELAY 30000
+#define HW_TICKS_PER_US 1
+
+static inline void hw_timerStart(void (*callback)(void)) {
+  sim_timerCallback = callback;
+  sim_timerDeadline = sim_now;
+  sim_timerRunning = true;
+}
+
+static inline void hw_timerSchedule(uint32_t delay) {
+  sim_timerDeadline += delay;
+}
+
+static inline void hw_timerScheduleTicks(uint16_t ticks) {
+  hw_timerSchedule(ticks);
+}
+
+static inline void hw_timerStop() {
+  sim_timerRunning = false;
+}
+
+// Pin writes of compiled programs go through hw_digitalWrite()
+static inline void *hw_pinPort(int) {
+  return 0;
+}
+
+static inline uint32_t hw_pinMask(int pin) {
+  return pin;
+}
+
+static inline void hw_portWrite(void *, uint32_t mask, int value) {
+  hw_digitalWrite(mask, value);
+}
+
+#endif
@@ -1,12 +1,18 @@
 #include <cstdio>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
-#define RF_CONTROL_VARDUINO
-#define MAX_RECORDINGS 255
+#include "sim_hal.h"
+#include "capture.h"
+#include "synth.h"
 #include "../RFControl.h"
 
 static char sate2string[6][255] = {
@@ -18,8 +24,6 @@ static char sate2string[6][255] = {
 "STATUS_RECORDING_END"
 };
 
-void (*sim_interruptCallback)(void);
-
 unsigned int sim_timings[] = {
 
 	// test with 1 footer pulse
@@ -214,86 +218,821 @@ unsigned int sim_timings[] = {
 59, 1075, 45, 972, 26, 895, 64, 983, 36, 860
 
 };
+// PT2262 style, 1:3 pulses and a sync of 31 periods
+const RFProtocol sim_protocols[] = {
+	{ 1, 50, { 4, 12, 124, 0, 0, 0, 0, 0 }, { RF_PAIR(0, 1), RF_PAIR(1, 0), 0, 2, RF_MSB_FIRST } }
+};
+
 size_t sim_timings_pos;
 size_t sim_timings_size;
 
-int main(int argc, const char* argv[])
-{
-	sim_timings_pos = 0;
-	sim_timings_size = sizeof(sim_timings)/sizeof(unsigned int);
-	unsigned int pulse_length_divider = RFControl::getPulseLengthDivider();
-	RFControl::startReceiving(0);
+// Checks that failed, main() exits with 1 if there are any
+int sim_failed = 0;
 
-	while(sim_timings_pos < sim_timings_size) {
+const char *sim_verdict(bool ok) {
+	if(!ok) {
+		sim_failed++;
+	}
+	return ok ? "ok" : "failed";
+}
+
+// Time of the last received edge
+unsigned long sim_rxTime = 0;
 
+// Feeds an edge at time to the receiver interrupt
+void sim_receiveAt(unsigned long time) {
+	sim_rxTime = time;
+	sim_now = sim_rxTime;
+	sim_rxPulses++;
+	if(sim_interruptCallback) {
 		sim_interruptCallback();
+	}
+}
+
+// Feeds a pulse to the receiver interrupt
+void sim_receive(unsigned int pulse) {
+	sim_receiveAt(sim_rxTime + pulse);
+}
+
+int sim_sendsDone = 0;
+unsigned long sim_sendDoneTime;
+
+void sim_sendDone() {
+	sim_sendsDone++;
+	sim_sendDoneTime = sim_now;
+}
 
+// Runs the virtual timer until the transmitter is done
+void sim_runTimer() {
+	while(sim_timerRunning) {
+		sim_now = sim_timerDeadline;
+		sim_timerCallback();
+	}
+}
+
+// Checks the recorded edges against the requested timings
+bool sim_checkEdges(const char *name, unsigned int *timings, size_t timings_size, unsigned int repeats) {
+	unsigned long total = 0;
+	for(size_t i=0; i < timings_size; i++) {
+		total += timings[i] * repeats;
+	}
+	unsigned long max_error = 0;
+	for(size_t i=1; i < sim_edges_size; i++) {
+		unsigned long requested = timings[(i-1) % timings_size];
+		unsigned long actual = sim_edges[i] - sim_edges[i-1];
+		unsigned long error = actual > requested ? actual - requested : requested - actual;
+		if(error > max_error) {
+			max_error = error;
+		}
+	}
+	bool ok = sim_edges_size == timings_size * repeats && sim_sendDoneTime - sim_edges[0] == total && !RFControl::isSending();
+	printf("%s: %zu edges, max error %lu us, %s\n", name, sim_edges_size, max_error, sim_verdict(ok));
+	return ok;
+}
+
+// Sends with the asynchronous transmitter and a compiled program
+void sim_transmit() {
+	unsigned int timings[] = { 400, 1200, 1200, 400, 400, 1200, 400, 45000 };
+	size_t timings_size = sizeof(timings)/sizeof(unsigned int);
+	unsigned int repeats = 2;
+	RFControl::stopReceiving();
+	sim_edges_size = 0;
+	RFControl::sendAsync(1, timings, timings_size, repeats, sim_sendDone);
+	sim_runTimer();
+	sim_checkEdges("transmit", timings, timings_size, repeats);
+
+	RFTxProgram program;
+	uint16_t ticks[16];
+	RFControl::compileProgram(&program, 1, timings, timings_size, ticks, 16);
+	sim_edges_size = 0;
+	RFControl::sendProgramAsync(&program, repeats, sim_sendDone);
+	sim_runTimer();
+	sim_checkEdges("program", timings, timings_size, repeats);
+
+	// Same message as a packed pattern with buckets in getRaw() units
+	static const uint16_t flash_buckets[8] = { 100, 300, 11250 };
+	static const uint8_t flash_packed[] = { 0x48, 0x80, 0x40 };
+	sim_edges_size = 0;
+	RFControl::sendFlashAsync(1, flash_buckets, flash_packed, timings_size, repeats, sim_sendDone);
+	sim_runTimer();
+	sim_checkEdges("flash", timings, timings_size, repeats);
+
+	// Output of compressTimings() as it is, with the buckets in getRaw() units
+	unsigned int indices[8];
+	unsigned int buckets[8];
+	for(size_t i=0; i < timings_size; i++) {
+		indices[i] = timings[i] / RFControl::getPulseLengthDivider();
+	}
+	RFControl::compressTimings(buckets, indices, timings_size);
+	sim_edges_size = 0;
+	RFControl::sendAsync(1, buckets, indices, timings_size, repeats, sim_sendDone);
+	sim_runTimer();
+	sim_checkEdges("indices", timings, timings_size, repeats);
+}
+
+// Sends a long frame blocking and checks each edge against its deadline
+void sim_blocking() {
+	unsigned int timings[100];
+	size_t timings_size = sizeof(timings)/sizeof(unsigned int);
+	for(size_t i=0; i < timings_size; i++) {
+		timings[i] = i % 3 == 0 ? 1200 : 400;
+	}
+	sim_edges_size = 0;
+	RFControl::sendByTimings(1, timings, timings_size, 1);
+	unsigned long requested = 0;
+	long max_error = 0;
+	for(size_t i=1; i < sim_edges_size; i++) {
+		requested += timings[i-1];
+		long error = (long)(sim_edges[i] - sim_edges[0]) - (long)requested;
+		if(error < 0) {
+			error = -error;
+		}
+		if(error > max_error) {
+			max_error = error;
+		}
+	}
+	printf("blocking: %zu edges, max edge error %ld us, %s\n", sim_edges_size, max_error,
+		sim_verdict(sim_edges_size == timings_size && max_error <= SIM_WRITE_COST + 1));
+}
+
+// Completion order and ids of queued sends
+char sim_order[8];
+int sim_doneIds[8];
+size_t sim_order_size = 0;
+void sim_done(char name, int id) {
+	sim_doneIds[sim_order_size] = id;
+	sim_order[sim_order_size++] = name;
+}
+void sim_doneA(int id) { sim_done('A', id); }
+void sim_doneB(int id) { sim_done('B', id); }
+void sim_doneC(int id) { sim_done('C', id); }
+void sim_doneD(int id) { sim_done('D', id); }
+
+// Queues sends with different priorities and send times, the same
+// message is only coalesced with an entry for the same send time
+void sim_queue() {
+	unsigned int a[] = { 400, 1200, 400, 12400 };
+	unsigned int b[] = { 400, 1200, 400, 12400 };
+	unsigned int c[] = { 400, 1200, 400, 12400 };
+	unsigned int d[] = { 400, 1200, 400, 12400 };
+	size_t n = 4;
+	sim_edges_size = 0;
+	int ids[5];
+	ids[0] = RFControl::queueSend(1, a, n, 1, 0, 0, sim_doneA);
+	ids[2] = RFControl::queueSend(1, b, n, 1, 0, 0, sim_doneB);
+	ids[1] = RFControl::queueSend(1, c, n, 1, 5, 0, sim_doneC);
+	bool coalesced = RFControl::queueSend(1, b, n, 2, 0, 0, sim_doneB) == ids[2];
+	ids[3] = RFControl::queueSend(1, d, n, 1, 9, sim_now + 1000000, sim_doneD);
+	ids[4] = RFControl::queueSend(1, b, n, 1, 0, sim_now + 1000000, sim_doneB);
+	bool separate = ids[4] != ids[2];
+	sim_runTimer();
+	sim_order[sim_order_size] = 0;
+	bool reported = sim_order_size == 5;
+	for(size_t i=0; reported && i < sim_order_size; i++) {
+		reported = sim_doneIds[i] == ids[i];
+	}
+	printf("queue: order %s, %zu edges, %s\n", sim_order, sim_edges_size,
+		sim_verdict(strcmp(sim_order, "ACBDB") == 0 && coalesced && separate && reported &&
+			sim_edges_size == n * 7 && !RFControl::isQueued(ids[2]) && !RFControl::isQueued(ids[4])));
+}
+
+// A 24 bit frame of another transmitter, ending with its sync
+#define SIM_FRAME_SIZE 50
+void sim_frame(unsigned int frame[SIM_FRAME_SIZE]) {
+	for(size_t i=0; i < 48; i += 2) {
+		frame[i] = i % 6 == 0 ? 1200 : 400;
+		frame[i+1] = i % 6 == 0 ? 400 : 1200;
+	}
+	frame[48] = 400;
+	frame[49] = 12400;
+}
+
+// Starts an asynchronous send while a message with repeats is in the
+// air, the first edge must wait until the guard time after the message
+void sim_csma() {
+	unsigned int frame[SIM_FRAME_SIZE];
+	size_t frame_size = SIM_FRAME_SIZE;
+	sim_frame(frame);
+	unsigned int timings[] = { 400, 1200, 400, 12400 };
+	size_t timings_size = sizeof(timings)/sizeof(unsigned int);
+	unsigned int repeats = 4;
+
+	sim_now += 100000;
+	sim_rxTime = sim_now;
+	// Level is low after an even number of pulses
+	sim_rxPulses = 0;
+	RFControl::startReceiving(0);
+	RFControl::resetTransmitStats();
+	sim_receive(400);
+	sim_receive(12400);
+	for(size_t i=0; i < frame_size + 10; i++) {
+		sim_receive(frame[i % frame_size]);
+	}
+	sim_edges_size = 0;
+	RFControl::sendAsync(1, timings, timings_size, 1, sim_sendDone);
+	for(size_t i=frame_size + 10; i < frame_size * repeats; i++) {
+		unsigned long next = sim_rxTime + frame[i % frame_size];
+		while(sim_timerRunning && sim_timerDeadline < next) {
+			sim_now = sim_timerDeadline;
+			sim_timerCallback();
+		}
+		sim_receive(frame[i % frame_size]);
+	}
+	// 20 periods of 400 us after the sync gap
+	unsigned long guard = 20 * 400 + 12400;
+	unsigned long end = sim_rxTime;
+	sim_runTimer();
+	RFTransmitStats stats;
+	RFControl::getTransmitStats(&stats);
+	printf("csma: first edge %lu us after the message, %s\n", sim_edges[0] - end,
+		sim_verdict(sim_edges_size == timings_size && sim_edges[0] >= end + guard * 9 / 10 && sim_edges[0] < end + guard * 2
+		&& stats.sends == 1 && stats.deferred == 1 && stats.waitMicros > 0));
+	RFControl::stopReceiving();
+}
+
+// Toggles the first pulse of the frame from the third repeat on
+void sim_beforeRepeat(RFPackedTimings *frame, unsigned int repeat) {
+	RFControl::setPackedIndex(frame->data, 0, repeat >= 2 ? 1 : 0);
+}
+
+// Checks a burst of alternating frames with a gap between repeats
+bool sim_checkBurst(const char *name, unsigned long *expected, size_t expected_size, unsigned long tolerance) {
+	long max_error = 0;
+	unsigned long requested = 0;
+	for(size_t i=1; i < sim_edges_size && i <= expected_size; i++) {
+		requested += expected[i-1];
+		long error = (long)(sim_edges[i] - sim_edges[0]) - (long)requested;
+		if(error < 0) {
+			error = -error;
+		}
+		if(error > max_error) {
+			max_error = error;
+		}
+	}
+	bool ok = sim_edges_size == expected_size && (unsigned long)max_error <= tolerance;
+	printf("%s: %zu edges, max edge error %ld us, %s\n", name, sim_edges_size, max_error, sim_verdict(ok));
+	return ok;
+}
+
+void sim_burst() {
+	unsigned int indices[2][6] = { { 0, 1, 0, 1, 0, 2 }, { 1, 0, 1, 0, 0, 2 } };
+	unsigned int buckets[3] = { 400, 1200, 12400 };
+	uint8_t data[2][3];
+	RFPackedTimings frames[2];
+	for(size_t f=0; f < 2; f++) {
+		for(size_t i=0; i < 8; i++) {
+			frames[f].buckets[i] = i < 3 ? buckets[i] / RFControl::getPulseLengthDivider() : 0;
+		}
+		frames[f].size = 6;
+		frames[f].data = data[f];
+		RFControl::packTimings(indices[f], 6, data[f]);
+	}
+	RFTransmission transmission = { 1, frames, 2, 3, 10000, sim_beforeRepeat };
+
+	// Repeat 0 and 2 send frame 0, the hook sets the first pulse of each
+	unsigned long expected[18];
+	for(size_t r=0; r < 3; r++) {
+		for(size_t i=0; i < 6; i++) {
+			unsigned int index = i == 0 ? r >= 2 : indices[r & 1][i];
+			expected[r*6 + i] = buckets[index] + (i == 5 && r < 2 ? transmission.gap : 0);
+		}
+	}
+	sim_edges_size = 0;
+	RFControl::sendTransmission(&transmission);
+	sim_checkBurst("burst", expected, 18, SIM_WRITE_COST + 1);
+
+	sim_edges_size = 0;
+	RFControl::sendTransmissionAsync(&transmission, sim_sendDone);
+	sim_runTimer();
+	sim_checkBurst("burst async", expected, 18, 0);
+}
+
+// Sends a frame with an odd number of pulses, it ends high and the
+// next repeat starts low again when its last pulse is over. Blocking
+// and asynchronous sends must give the same edges, the first edge of
+// the repeat follows the low write and is late by one write.
+void sim_oddFrame() {
+	unsigned int timings[] = { 400, 1200, 400 };
+	unsigned long expected[] = { 400, 1200, 400, 0, 400, 1200, 400, 0 };
+	size_t expected_size = sizeof(expected)/sizeof(unsigned long);
+	sim_edges_size = 0;
+	RFControl::sendByTimings(1, timings, 3, 2);
+	sim_checkBurst("odd frame", expected, expected_size, 2 * SIM_WRITE_COST + 1);
+
+	sim_edges_size = 0;
+	RFControl::sendAsync(1, timings, 3, 2, sim_sendDone);
+	sim_runTimer();
+	sim_checkBurst("odd frame async", expected, expected_size, 2 * SIM_WRITE_COST + 1);
+}
+
+// Receives while sending, the echo of each transmitted edge arrives
+// 100 us later and must be dropped, an answer right after the send
+// must be received
+void sim_duplex() {
+	unsigned int timings[] = { 400, 1200, 400, 12400 };
+	size_t timings_size = sizeof(timings)/sizeof(unsigned int);
+	unsigned int frame[SIM_FRAME_SIZE];
+	sim_frame(frame);
+
+	sim_now += 100000;
+	sim_rxTime = sim_now;
+	sim_rxPulses = 0;
+	RFControl::enableReceiveWhileSending();
+	RFControl::startReceiving(0);
+	RFControl::resetTransmitStats();
+	sim_edges_size = 0;
+	RFControl::sendAsync(1, timings, timings_size, 2, sim_sendDone);
+	size_t echoed = 0;
+	while(sim_timerRunning || echoed < sim_edges_size) {
+		if(echoed < sim_edges_size && (!sim_timerRunning || sim_edges[echoed] + 100 < sim_timerDeadline)) {
+			sim_receiveAt(sim_edges[echoed++] + 100);
+		} else {
+			sim_now = sim_timerDeadline;
+			sim_timerCallback();
+		}
+	}
+	// The answer
+	sim_receive(400);
+	sim_receive(12400);
+	for(size_t i=0; i < SIM_FRAME_SIZE * 2; i++) {
+		sim_receive(frame[i % SIM_FRAME_SIZE]);
+	}
+	unsigned int timings_received = 0;
+	if(RFControl::hasData()) {
+		unsigned int *received;
+		RFControl::getRaw(&received, &timings_received);
+		RFControl::continueReceiving();
+	}
+	RFTransmitStats stats;
+	RFControl::getTransmitStats(&stats);
+	printf("duplex: %lu echoes dropped, %u timings received, %s\n", stats.echoes, timings_received,
+		sim_verdict(stats.echoes == echoed && echoed == timings_size * 2 && timings_received == SIM_FRAME_SIZE));
+	RFControl::stopReceiving();
+	RFControl::disableReceiveWhileSending();
+}
+
+// Feeds the recorded transmitter edges back into the receiver and
+// compares what it decodes with the frame that was sent
+bool sim_loopback(const char *name, unsigned int *frame, size_t frame_size) {
+	sim_now += 100000;
+	sim_rxPulses = 1;
+	RFControl::startReceiving(0);
+	for(size_t i=0; i < sim_edges_size; i++) {
+		sim_receiveAt(sim_edges[i]);
+	}
+	unsigned int *timings;
+	unsigned int timings_size = 0;
+	unsigned long max_error = 0;
+	if(RFControl::hasData()) {
+		RFControl::getRaw(&timings, &timings_size);
+		for(size_t i=0; i < timings_size && i < frame_size; i++) {
+			unsigned long received = timings[i] * RFControl::getPulseLengthDivider();
+			unsigned long error = received > frame[i] ? received - frame[i] : frame[i] - received;
+			if(error > max_error) {
+				max_error = error;
+			}
+		}
+		RFControl::continueReceiving();
+	}
+	RFControl::stopReceiving();
+	bool ok = timings_size == frame_size && max_error <= RFControl::getPulseLengthDivider();
+	printf("%s: %u timings received, max error %lu us, %s\n", name, timings_size, max_error, sim_verdict(ok));
+	return ok;
+}
+
+// Calibrates the transmitter and checks both transmitters in loopback
+void sim_calibrate() {
+	unsigned int overhead = RFControl::calibrateTransmitter(1);
+	unsigned int frame[SIM_FRAME_SIZE];
+	sim_frame(frame);
+	sim_edges_size = 0;
+	RFControl::sendByTimings(1, frame, SIM_FRAME_SIZE, 3);
+	// Pulse widths, the first one shows whether the overhead is compensated
+	long max_error = 0;
+	for(size_t i=1; i < sim_edges_size; i++) {
+		long error = (long)(sim_edges[i] - sim_edges[i-1]) - (long)frame[(i-1) % SIM_FRAME_SIZE];
+		if(error < 0) {
+			error = -error;
+		}
+		if(error > max_error) {
+			max_error = error;
+		}
+	}
+	printf("calibrate: overhead %u us, max pulse error %ld us, %s\n", overhead, max_error,
+		sim_verdict(overhead == SIM_WRITE_COST && max_error <= 1));
+	sim_loopback("loopback", frame, SIM_FRAME_SIZE);
+
+	sim_edges_size = 0;
+	RFControl::sendAsync(1, frame, SIM_FRAME_SIZE, 3, sim_sendDone);
+	sim_runTimer();
+	sim_loopback("loopback async", frame, SIM_FRAME_SIZE);
+	RFControl::setTransmitterOverhead(0);
+}
+
+// Messages received, matched to a protocol and with failed checks
+size_t sim_messages = 0;
+size_t sim_matched = 0;
+size_t sim_mismatches = 0;
+
+// What sim_printMessage() found in the last message
+int sim_protocol;
+uint64_t sim_payload;
+uint32_t sim_signature;
+bool sim_streamed;
+
+// Prints a received message and checks it against packing, protocol
+// matching, signatures and the streaming compressor
+void sim_printMessage() {
+	unsigned int pulse_length_divider = RFControl::getPulseLengthDivider();
+	unsigned int *timings;
+	unsigned int timings_size;
+	sim_messages++;
+	RFControl::getRaw(&timings, &timings_size);
+	printf("result: \n");
+	for(size_t i=0; i < timings_size; i++) {
+		unsigned long timing = timings[i] * pulse_length_divider;
+		printf("%lu ", timing);
+		if((i+1)%16 == 0) {
+			printf("\n");
+		}
+	}
+	printf("\n");
+	unsigned int buckets[8];
+	RFControl::compressTimings(buckets, timings, timings_size);
+	printf("compressed: ");
+	for(size_t i=0; i < 8; i++) {
+		unsigned long bucket = buckets[i] * pulse_length_divider;
+		printf("%lu ", bucket);
+	}
+	printf(" t: ");
+	for(size_t i=0; i < timings_size; i++) {
+		printf("%i", timings[i]);
+	}
+	printf("\n");
+
+	RFPackedTimings packed;
+	unsigned int indices[MAX_RECORDINGS];
+	memcpy(indices, timings, timings_size * sizeof(unsigned int));
+	memcpy(packed.buckets, buckets, sizeof(buckets));
+	packed.size = timings_size;
+	packed.data = (uint8_t*)timings;
+	RFControl::packTimings(timings, timings_size, packed.data);
+	printf("packed: %u bytes ", RFControl::getPackedSize(timings_size));
+	unsigned int unpacked[MAX_RECORDINGS];
+	RFControl::unpackTimings(&packed, unpacked);
+	if(memcmp(indices, unpacked, timings_size * sizeof(unsigned int)) != 0) {
+		printf("unpack mismatch\n");
+		sim_mismatches++;
+	} else {
+		printf("ok\n");
+	}
+
+	uint64_t payload = 0;
+	int protocol = RFControl::matchProtocol(sim_protocols, 1, buckets, indices, timings_size, &payload);
+	if(protocol >= 0) {
+		sim_matched++;
+		printf("protocol: %d payload: %llx\n", protocol, (unsigned long long)payload);
+	}
+	sim_protocol = protocol;
+	sim_payload = payload;
+
+	RFSignature signature;
+	RFControl::computeSignature(&signature, buckets, indices, timings_size);
+	printf("signature: %08lx\n", (unsigned long)signature.key);
+	sim_signature = signature.key;
+	// The key must not depend on the order the buckets are numbered in
+	unsigned int reversed[8];
+	for(size_t i=0; i < 8; i++) {
+		reversed[i] = buckets[7 - i];
+	}
+	for(size_t i=0; i < timings_size; i++) {
+		unpacked[i] = 7 - indices[i];
+	}
+	RFSignature renumbered;
+	RFControl::computeSignature(&renumbered, reversed, unpacked, timings_size);
+	if(renumbered.key != signature.key) {
+		printf("signature depends on the bucket order\n");
+		sim_mismatches++;
+	}
+
+	sim_streamed = false;
+	if(RFControl::hasCompressedData()) {
+		RFPackedTimings streamed;
+		RFControl::getCompressed(&streamed);
+		bool same = streamed.size == timings_size;
+		for(size_t i=0; same && i < 8; i++) {
+			same = streamed.buckets[i] == buckets[i];
+		}
+		for(size_t i=0; same && i < timings_size; i++) {
+			same = RFControl::getPackedIndex(streamed.data, i) == indices[i];
+		}
+		printf("streamed: %s\n", same ? "ok" : "mismatch");
+		sim_mismatches += !same;
+		sim_streamed = same;
+		RFControl::continueCompressed();
+	}
+
+	RFControl::continueReceiving();
+}
+
+// Feeds a pulse to the receiver and prints the message it completes
+void sim_feed(unsigned int pulse) {
+	sim_receive(pulse);
+	if(RFControl::hasData()) {
+		sim_printMessage();
+	}
+}
+
+// Remote of sim_decode(), PT2262 style as in sim_protocols. The first
+// bit of the code is 0, so the frame starts with a short pulse.
+#define SIM_CODE 0x5a3c96
+#define SIM_PERIOD 350
+#define SIM_SYNC (31 * SIM_PERIOD)
+#define SIM_SIGNATURE 0x92c8626d
+
+// Frame of a 24 bit code, most significant bit first, ending with its sync
+void sim_codeFrame(unsigned int frame[SIM_FRAME_SIZE], uint32_t code) {
+	for(size_t i=0; i < 24; i++) {
+		bool one = (code >> (23 - i)) & 1;
+		frame[2*i] = one ? 3 * SIM_PERIOD : SIM_PERIOD;
+		frame[2*i+1] = one ? SIM_PERIOD : 3 * SIM_PERIOD;
+	}
+	frame[48] = SIM_PERIOD;
+	frame[49] = SIM_SYNC;
+}
+
+// Receives a burst of a known code and checks the protocol, payload,
+// signature and streamed compression of every message, from the first
+// frame to the last one before the gap
+void sim_decode() {
+	unsigned int frame[SIM_FRAME_SIZE];
+	sim_codeFrame(frame, SIM_CODE);
+	const unsigned int repeats = 4;
+
+	sim_now += 100000;
+	sim_rxTime = sim_now;
+	sim_rxPulses = 0;
+	RFControl::startReceiving(0);
+	// The end of a previous frame, so the first frame is received too
+	unsigned int pulses[2 + SIM_FRAME_SIZE * repeats + 1];
+	size_t pulses_size = 0;
+	pulses[pulses_size++] = SIM_PERIOD;
+	pulses[pulses_size++] = SIM_SYNC;
+	for(size_t i=0; i < SIM_FRAME_SIZE * repeats; i++) {
+		pulses[pulses_size++] = frame[i % SIM_FRAME_SIZE];
+	}
+	// The last frame is followed by a gap instead of another frame, it
+	// must still have the same signature as the first
+	pulses[pulses_size - 1] = SIM_SYNC + 30000;
+	pulses[pulses_size++] = SIM_PERIOD;
+
+	size_t messages = 0;
+	size_t decoded = 0;
+	for(size_t i=0; i < pulses_size; i++) {
+		sim_receive(pulses[i]);
 		if(RFControl::hasData()) {
+			sim_printMessage();
+			messages++;
+			decoded += sim_protocol == 1 && sim_payload == SIM_CODE && sim_signature == SIM_SIGNATURE && sim_streamed;
+		}
+	}
+	printf("decode: %zu messages, %zu decoded to %x, %s\n", messages, decoded, SIM_CODE,
+		sim_verdict(messages == repeats && decoded == repeats));
+	RFControl::stopReceiving();
+}
+
+// Matches clean generated PT2262 transmissions against sim_protocols.
+// Frames start with either pulse length, and the last frame of each
+// transmission is followed by a longer gap than its sync.
+void sim_synthProtocols() {
+	SynthOptions options;
+	synth_defaults(&options);
+	options.transmissions = 50;
+	SynthSignal signal;
+	synth_generate(&options, &signal);
+
+	sim_now += 100000;
+	sim_rxTime = sim_now;
+	sim_rxPulses = 0;
+	RFControl::startReceiving(0);
+	unsigned long start = sim_rxTime;
+	size_t frame = 0;
+	size_t messages = 0;
+	size_t decoded = 0;
+	size_t longFirst = 0;
+	size_t beforeGap = 0;
+	for(size_t i=0; i < signal.pulses_size; i++) {
+		sim_receive(signal.pulses[i]);
+		while(RFControl::hasData()) {
+			// A message is complete at the edge after its sync
+			unsigned long end = sim_rxTime - start;
+			while(frame + 1 < signal.frames_size && signal.frames[frame + 1].end <= end) {
+				frame++;
+			}
+			const SynthFrame *f = &signal.frames[frame];
 			unsigned int *timings;
 			unsigned int timings_size;
-			RFControl::getRaw(&timings, &timings_size);
-			printf("result: \n");
-			for(size_t i=0; i < timings_size; i++) {
-				unsigned long timing = timings[i] * pulse_length_divider;
-				printf("%lu ", timing);
-				if((i+1)%16 == 0) {
-					printf("\n");
-				}
-			}
-			printf("\n");
 			unsigned int buckets[8];
-			RFControl::compressTimings(buckets, timings, timings_size);
-			printf("compressed: ");
-			for(size_t i=0; i < 8; i++) {
-				unsigned long bucket = buckets[i] * pulse_length_divider;
-				printf("%lu ", bucket);
+			uint64_t payload = 0;
+			RFControl::getRaw(&timings, &timings_size);
+			int protocol = -1;
+			if(RFControl::compressTimings(buckets, timings, timings_size)) {
+				protocol = RFControl::matchProtocol(sim_protocols, 1, buckets, timings, timings_size, &payload);
 			}
-			printf(" t: ");
-			for(size_t i=0; i < timings_size; i++) {
-			  printf("%i", timings[i]);
+			messages++;
+			if(protocol == 1 && payload == f->payload) {
+				decoded++;
+				longFirst += (f->payload >> (options.bits - 1)) & 1;
+				beforeGap += frame + 1 == signal.frames_size || signal.frames[frame + 1].transmission != f->transmission;
 			}
-			printf("\n");
-
 			RFControl::continueReceiving();
-		  }
+		}
 	}
+	printf("protocols: %zu messages, %zu of %zu frames decoded, %zu starting long, %zu before a gap, %s\n",
+		messages, decoded, signal.frames_size, longFirst, beforeGap,
+		sim_verdict(messages == signal.frames_size && decoded == signal.frames_size && longFirst > 0 && beforeGap == options.transmissions));
+	RFControl::stopReceiving();
+	synth_free(&signal);
+}
 
-
+// Replays a capture file, returns the number of pulses or -1
+long sim_replay(const char *path) {
+	return sim_readCapture(path, sim_feed);
 }
 
+// Totals of one replayed file
+struct SimResult {
+	int file;
+	long pulses;
+	size_t messages;
+	size_t matched;
+	size_t mismatches;
+	unsigned long signal;
+	double seconds;
+};
 
-void hw_attachInterrupt(uint8_t, void (*ic)(void)) {
-	sim_interruptCallback = ic;
+SimResult sim_replayFile(const char *path, int file) {
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	// Each file starts with a high pulse on an idle receiver at time 0,
+	// so the results do not depend on the files replayed before
+	sim_rxPulses = 0;
+	sim_now = sim_rxTime = 0;
+	RFControl::startReceiving(0);
+	SimResult result = { file, 0, sim_messages, sim_matched, sim_mismatches, sim_rxTime, 0 };
+	result.pulses = sim_replay(path);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	result.messages = sim_messages - result.messages;
+	result.matched = sim_matched - result.matched;
+	result.mismatches = sim_mismatches - result.mismatches;
+	result.signal = sim_rxTime - result.signal;
+	result.seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	return result;
 }
 
-unsigned long hw_micros(void) {
-	static unsigned long duration = 0;
-	if(sim_timings_pos < sim_timings_size) {
-		duration += sim_timings[sim_timings_pos++];
-		return duration;
-	} else {
-		printf("No timings left...\n");
-	}
-	return 0;
+void sim_printResult(const char *path, const SimResult *result) {
+	fprintf(stderr, "%s: %ld pulses, %zu messages, %zu matched, %zu mismatches, %.1f s of signal in %.3f s\n",
+		path, result->pulses, result->messages, result->matched, result->mismatches, result->signal / 1e6, result->seconds);
 }
 
+/* Replays files in jobs worker processes. The receiver state is
+   global, so each worker is a forked process with its own copy of it.
+   Workers take the next file from a counter in shared memory and send
+   its SimResult through a pipe. With outdir the messages of each file
+   are written to outdir, named after the path, so the output of two
+   versions can be compared with diff -r. Otherwise only the totals
+   are printed.
+ */
+int sim_batch(int jobs, const char *outdir, const char **files, int files_size) {
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int *next = (int*)mmap(0, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	int fds[2];
+	if(next == MAP_FAILED || pipe(fds) < 0) {
+		perror("batch");
+		return 1;
+	}
+	*next = 0;
+	fflush(stdout);
+	for(int j=0; j < jobs; j++) {
+		if(fork() != 0) {
+			continue;
+		}
+		close(fds[0]);
+		int file;
+		while((file = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED)) < files_size) {
+			char name[4096] = "/dev/null";
+			if(outdir) {
+				snprintf(name, sizeof(name), "%s/", outdir);
+				size_t length = strlen(name);
+				for(const char *c = files[file]; *c && length + 5 < sizeof(name); c++) {
+					name[length++] = *c == '/' ? '_' : *c;
+				}
+				strcpy(name + length, ".txt");
+			}
+			if(!freopen(name, "w", stdout)) {
+				perror(name);
+				_exit(1);
+			}
+			SimResult result = sim_replayFile(files[file], file);
+			fflush(stdout);
+			if(write(fds[1], &result, sizeof(result)) != sizeof(result)) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+	close(fds[1]);
 
-void hw_pinMode(uint8_t, uint8_t){}
-void hw_digitalWrite(uint8_t, uint8_t){}
-int hw_digitalRead(uint8_t){return 0;}
-int hw_analogRead(uint8_t){return 0;}
-void hw_analogReference(uint8_t mode){}
-void hw_analogWrite(uint8_t, int){}
-void hw_delayMicroseconds(unsigned int us){}
-void hw_detachInterrupt(uint8_t){}
+	SimResult *results = (SimResult*)calloc(files_size, sizeof(SimResult));
+	bool *done = (bool*)calloc(files_size, sizeof(bool));
+	SimResult result;
+	while(read(fds[0], &result, sizeof(result)) == sizeof(result)) {
+		results[result.file] = result;
+		done[result.file] = true;
+	}
+	while(wait(0) > 0) {
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
 
-#define HIGH 0x1
-#define LOW  0x0
-#define INPUT 0x0
-#define OUTPUT 0x1
+	SimResult total = { 0, 0, 0, 0, 0, 0, 0 };
+	int failed = 0;
+	for(int i=0; i < files_size; i++) {
+		if(!done[i] || results[i].pulses < 0) {
+			fprintf(stderr, "%s: failed\n", files[i]);
+			failed++;
+			continue;
+		}
+		sim_printResult(files[i], &results[i]);
+		total.pulses += results[i].pulses;
+		total.messages += results[i].messages;
+		total.matched += results[i].matched;
+		total.mismatches += results[i].mismatches;
+		total.signal += results[i].signal;
+		total.seconds += results[i].seconds;
+	}
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "total: %d files, %d failed, %ld pulses, %zu messages, %zu matched, %zu mismatches, %.1f s of signal in %.3f s with %d jobs\n",
+		files_size, failed, total.pulses, total.messages, total.matched, total.mismatches, total.signal / 1e6, seconds, jobs);
+	free(results);
+	free(done);
+	return failed || total.mismatches ? 1 : 0;
+}
 
-#define CHANGE 1	
-#define FALLING 2
-#define RISING 3
+int main(int argc, const char* argv[])
+{
+	RFControl::startReceiving(0);
+	static uint8_t stream_buffer[2 * (MAX_RECORDINGS * 3 + 7) / 8];
+	RFControl::enableStreamCompression(stream_buffer, sizeof(stream_buffer));
 
-#include "../RFControl.cpp"
\ No newline at end of file
+	// simulate [-j jobs] [-o outdir] file...
+	int jobs = 0;
+	const char *outdir = 0;
+	int first = 1;
+	while(first + 1 < argc && argv[first][0] == '-') {
+		if(strcmp(argv[first], "-j") == 0) {
+			jobs = atoi(argv[first + 1]);
+		}
+		else if(strcmp(argv[first], "-o") == 0) {
+			outdir = argv[first + 1];
+		}
+		else {
+			break;
+		}
+		first += 2;
+	}
+	if(jobs > 0) {
+		return sim_batch(jobs, outdir, argv + first, argc - first);
+	}
+	if(first < argc) {
+		// Replay capture files instead of the built in signal
+		for(int i=first; i < argc; i++) {
+			SimResult result = sim_replayFile(argv[i], i);
+			if(result.pulses < 0) {
+				perror(argv[i]);
+				return 1;
+			}
+			sim_printResult(argv[i], &result);
+		}
+		// Same as the batch mode, mismatches fail the run
+		return sim_mismatches ? 1 : 0;
+	}
+
+	sim_timings_pos = 0;
+	sim_timings_size = sizeof(sim_timings)/sizeof(unsigned int);
+	while(sim_timings_pos < sim_timings_size) {
+		sim_feed(sim_timings[sim_timings_pos++]);
+	}
+
+	sim_decode();
+	sim_synthProtocols();
+	sim_transmit();
+	sim_queue();
+	sim_blocking();
+	sim_burst();
+	sim_oddFrame();
+	sim_csma();
+	sim_calibrate();
+	sim_duplex();
+	return sim_failed || sim_mismatches ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "synth.h"
+
+const char *synth_protocolNames[SYNTH_PROTOCOLS] = {
+	"pt2262",
+	"manchester",
+	"distance"
+};
+
+// Usual periods in micros
+static const unsigned int synth_periods[SYNTH_PROTOCOLS] = {350, 500, 500};
+
+// Sync low pulse in periods, longer than the decoder's MAX_PULSE_PERIODS
+static const unsigned int synth_syncs[SYNTH_PROTOCOLS] = {31, 30, 24};
+
+// Silence between transmissions in micros
+#define SYNTH_MIN_GAP 10000
+#define SYNTH_MAX_GAP 40000
+
+// Width of glitches in micros
+#define SYNTH_MIN_GLITCH 10
+#define SYNTH_MAX_GLITCH 100
+
+// High pulse at the start and end of the signal, the last one ends the
+// sync of the last frame
+#define SYNTH_MARK 400
+
+void synth_defaults(SynthOptions *options) {
+	memset(options, 0, sizeof(SynthOptions));
+	options->protocol = SYNTH_PT2262;
+	options->bits = 24;
+	options->transmissions = 250;
+	options->repeats = 4;
+	options->seed = 1;
+}
+
+int synth_protocol(const char *name) {
+	for(int i=0; i < SYNTH_PROTOCOLS; i++) {
+		if(strcmp(name, synth_protocolNames[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// xorshift32, the signal only depends on the seed
+static uint32_t synth_state;
+
+static uint32_t synth_random() {
+	synth_state ^= synth_state << 13;
+	synth_state ^= synth_state >> 17;
+	synth_state ^= synth_state << 5;
+	return synth_state;
+}
+
+// Uniform in [0, 1)
+static double synth_uniform() {
+	return synth_random() / 4294967296.0;
+}
+
+static unsigned long *synth_edges;
+static size_t synth_edges_size;
+static size_t synth_edges_capacity;
+
+static void synth_edge(unsigned long time) {
+	if(synth_edges_size == synth_edges_capacity) {
+		synth_edges_capacity = synth_edges_capacity ? 2 * synth_edges_capacity : 4096;
+		synth_edges = (unsigned long*)realloc(synth_edges, synth_edges_capacity * sizeof(unsigned long));
+	}
+	synth_edges[synth_edges_size++] = time;
+}
+
+static size_t synth_frames_capacity;
+
+static SynthFrame *synth_addFrame(SynthSignal *signal) {
+	if(signal->frames_size == synth_frames_capacity) {
+		synth_frames_capacity = synth_frames_capacity ? 2 * synth_frames_capacity : 256;
+		signal->frames = (SynthFrame*)realloc(signal->frames, synth_frames_capacity * sizeof(SynthFrame));
+	}
+	return &signal->frames[signal->frames_size++];
+}
+
+// Appends a run of periods at level, merging it with the previous run
+// of the same level. Even runs are high.
+static void synth_run(unsigned int *units, unsigned int *size, int level, unsigned int periods) {
+	int last = *size > 0 && (*size - 1) % 2 == 0;
+	if(*size > 0 && last == level) {
+		units[*size - 1] += periods;
+	}
+	else {
+		units[(*size)++] = periods;
+	}
+}
+
+// Nominal frame as pulse lengths in periods, returns the pulse count
+static unsigned int synth_frame(SynthProtocol protocol, uint64_t payload, unsigned int bits, unsigned int units[SYNTH_MAX_FRAME]) {
+	unsigned int size = 0;
+	if(protocol == SYNTH_MANCHESTER) {
+		synth_run(units, &size, 1, 1);
+	}
+	for(unsigned int i=0; i < bits; i++) {
+		bool one = (payload >> (bits - 1 - i)) & 1;
+		switch(protocol) {
+		case SYNTH_PT2262:
+			synth_run(units, &size, 1, one ? 3 : 1);
+			synth_run(units, &size, 0, one ? 1 : 3);
+			break;
+		case SYNTH_MANCHESTER:
+			synth_run(units, &size, !one, 1);
+			synth_run(units, &size, one, 1);
+			break;
+		default:
+			synth_run(units, &size, 1, 1);
+			synth_run(units, &size, 0, one ? 4 : 2);
+			break;
+		}
+	}
+	if(protocol != SYNTH_MANCHESTER) {
+		synth_run(units, &size, 1, 1);
+	}
+	synth_run(units, &size, 0, synth_syncs[protocol]);
+	return size;
+}
+
+// Appends the repeated frames of one transmission starting at time,
+// returns the time after the last sync
+static double synth_transmission(SynthSignal *signal, const SynthOptions *options, SynthProtocol protocol,
+		unsigned int period, unsigned int repeats, bool foreign, unsigned int index, double time) {
+	uint64_t payload = ((uint64_t)synth_random() << 32) | synth_random();
+	if(options->bits < 64) {
+		payload &= ((uint64_t)1 << options->bits) - 1;
+	}
+	unsigned int units[SYNTH_MAX_FRAME];
+	unsigned int size = synth_frame(protocol, payload, options->bits, units);
+	double scale = period * (1 + options->drift * (2 * synth_uniform() - 1) / 100);
+	for(unsigned int r=0; r < repeats; r++) {
+		SynthFrame *frame = synth_addFrame(signal);
+		frame->start = (unsigned long)(time + 0.5);
+		frame->foreign = foreign;
+		frame->transmission = index;
+		frame->payload = payload;
+		frame->size = size;
+		unsigned int classes = 0;
+		for(unsigned int i=0; i < size; i++) {
+			// Classes are numbered in the order they first appear
+			unsigned int c = 0;
+			while(c < i && units[c] != units[i]) {
+				c++;
+			}
+			frame->classes[i] = c < i ? frame->classes[c] : classes++;
+			// Every pulse starts with an edge, the first is rising
+			synth_edge((unsigned long)(time + 0.5));
+			time += units[i] * scale;
+		}
+		frame->end = (unsigned long)(time + 0.5);
+	}
+	return time;
+}
+
+static double synth_gap() {
+	return SYNTH_MIN_GAP + synth_uniform() * (SYNTH_MAX_GAP - SYNTH_MIN_GAP);
+}
+
+// Removes high pulses, the low pulses around them merge
+static void synth_dropouts(double dropouts) {
+	size_t size = 2;
+	// Keep the first and the last high pulse
+	for(size_t i=2; i + 2 < synth_edges_size; i += 2) {
+		if(synth_uniform() * 100 >= dropouts) {
+			synth_edges[size++] = synth_edges[i];
+			synth_edges[size++] = synth_edges[i + 1];
+		}
+	}
+	synth_edges[size++] = synth_edges[synth_edges_size - 2];
+	synth_edges[size++] = synth_edges[synth_edges_size - 1];
+	synth_edges_size = size;
+}
+
+// Inserts short pulses of the opposite level at random times, glitches
+// that would cross an edge are left out
+static void synth_glitches(double rate) {
+	unsigned long *edges = synth_edges;
+	size_t edges_size = synth_edges_size;
+	synth_edges = 0;
+	synth_edges_size = synth_edges_capacity = 0;
+	double glitch = -log(1 - synth_uniform()) / rate * 1000000;
+	for(size_t i=0; i < edges_size; i++) {
+		while(glitch < edges[i]) {
+			unsigned long start = (unsigned long)glitch;
+			unsigned long width = SYNTH_MIN_GLITCH + synth_random() % (SYNTH_MAX_GLITCH - SYNTH_MIN_GLITCH);
+			if(i > 0 && start > edges[i - 1] && start + width < edges[i]) {
+				synth_edge(start);
+				synth_edge(start + width);
+			}
+			glitch += -log(1 - synth_uniform()) / rate * 1000000;
+		}
+		synth_edge(edges[i]);
+	}
+	free(edges);
+}
+
+// Moves every edge by up to jitter, the order of the edges is kept
+static void synth_jitter(unsigned int jitter) {
+	for(size_t i=0; i < synth_edges_size; i++) {
+		long moved = (long)synth_edges[i] + (long)(synth_random() % (2 * jitter + 1)) - (long)jitter;
+		if(i > 0 && moved <= (long)synth_edges[i - 1]) {
+			moved = synth_edges[i - 1] + 1;
+		}
+		synth_edges[i] = moved < 0 ? 0 : moved;
+	}
+}
+
+void synth_generate(const SynthOptions *options, SynthSignal *signal) {
+	synth_state = options->seed ? options->seed : 1;
+	synth_edges_size = 0;
+	signal->frames = 0;
+	signal->frames_size = 0;
+	synth_frames_capacity = 0;
+	unsigned int period = options->period ? options->period : synth_periods[options->protocol];
+
+	double time = 0;
+	synth_edge(0);
+	synth_edge(SYNTH_MARK);
+	time = SYNTH_MARK;
+	for(unsigned int t=0; t < options->transmissions; t++) {
+		time += synth_gap();
+		if(synth_uniform() * 100 < options->foreign) {
+			// Another protocol and sender with its own period
+			SynthProtocol protocol = (SynthProtocol)((options->protocol + 1 + synth_random() % (SYNTH_PROTOCOLS - 1)) % SYNTH_PROTOCOLS);
+			unsigned int foreignPeriod = 200 + synth_random() % 500;
+			time = synth_transmission(signal, options, protocol, foreignPeriod, 1 + synth_random() % 4, true, t, time);
+			time += synth_gap();
+		}
+		time = synth_transmission(signal, options, options->protocol, period, options->repeats, false, t, time);
+	}
+	time += synth_gap();
+	synth_edge((unsigned long)time);
+	synth_edge((unsigned long)time + SYNTH_MARK);
+
+	if(options->dropouts > 0) {
+		synth_dropouts(options->dropouts);
+	}
+	if(options->glitches > 0) {
+		synth_glitches(options->glitches);
+	}
+	if(options->jitter > 0) {
+		synth_jitter(options->jitter);
+	}
+
+	signal->pulses_size = synth_edges_size - 1;
+	signal->pulses = (unsigned int*)malloc(signal->pulses_size * sizeof(unsigned int));
+	for(size_t i=0; i < signal->pulses_size; i++) {
+		signal->pulses[i] = synth_edges[i + 1] - synth_edges[i];
+	}
+	free(synth_edges);
+	synth_edges = 0;
+	synth_edges_size = synth_edges_capacity = 0;
+}
+
+void synth_free(SynthSignal *signal) {
+	free(signal->pulses);
+	free(signal->frames);
+	signal->pulses = 0;
+	signal->frames = 0;
+	signal->pulses_size = signal->frames_size = 0;
+}
@@ -0,0 +1,80 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Synthetic OOK signals for measuring the capture rate. Transmissions
+   of a protocol are repeated frames with a trailing sync, separated by
+   silence. The ideal signal is degraded by the transmitter's clock
+   offset, edge jitter, short glitches, dropped high pulses and
+   transmissions of foreign senders in between. The generator keeps the
+   nominal pulse classes of every frame so decoded messages can be
+   checked against them.
+ */
+
+enum SynthProtocol {
+	// Short/long and long/short pulse pairs, PT2262 and EV1527 remotes
+	SYNTH_PT2262,
+	// Manchester coded half bits of one period
+	SYNTH_MANCHESTER,
+	// Fixed high pulse, the bit is in the length of the low pulse
+	SYNTH_DISTANCE,
+	SYNTH_PROTOCOLS
+};
+
+struct SynthOptions {
+	SynthProtocol protocol;
+	// Period in micros, 0 selects the protocol's usual one
+	unsigned int period;
+	unsigned int bits;
+	unsigned int transmissions;
+	unsigned int repeats;
+	// Max clock offset of a transmission in percent
+	double drift;
+	// Max displacement of an edge in micros
+	unsigned int jitter;
+	// Glitches per second of signal, silence included
+	double glitches;
+	// Probability in percent that a high pulse is lost
+	double dropouts;
+	// Probability in percent that a foreign transmission precedes one
+	double foreign;
+	uint32_t seed;
+};
+
+// Longest frame, a Manchester start half bit, 64 bits and the sync
+#define SYNTH_MAX_BITS 64
+#define SYNTH_MAX_FRAME (2 * SYNTH_MAX_BITS + 2)
+
+struct SynthFrame {
+	// Nominal start and end of the frame in micros
+	unsigned long start;
+	unsigned long end;
+	bool foreign;
+	unsigned int transmission;
+	uint64_t payload;
+	unsigned int size;
+	// Nominal length class of each pulse, numbered in order of appearance
+	uint8_t classes[SYNTH_MAX_FRAME];
+};
+
+struct SynthSignal {
+	unsigned int *pulses;
+	size_t pulses_size;
+	SynthFrame *frames;
+	size_t frames_size;
+};
+
+extern const char *synth_protocolNames[SYNTH_PROTOCOLS];
+
+void synth_defaults(SynthOptions *options);
+
+// Returns the protocol called name or -1
+int synth_protocol(const char *name);
+
+void synth_generate(const SynthOptions *options, SynthSignal *signal);
+
+void synth_free(SynthSignal *signal);
+
+#endif